@@ -1,37 +1,245 @@
 #include <cassert>
-#include <random>
 #include <limits>
 #include <vector>
 #include <numeric>
 #include <algorithm>
+#include <cstring>
 #include <benchmark/benchmark.h>
+#include <mpi.h>
 #include "binarytreesummation.h"
+#include "generator.h"
 
-static void BM_randomAdditionSingleRank(benchmark::State& state) {
-    std::mt19937 gen;
-    std::vector<double> arr;
-    for (size_t i = 0; i < 8192; i++) {
-        float num = gen() / (std::numeric_limits<unsigned int>::max() + 1UL);
-        assert(0.0f <= num);
-        assert(num < 1.0f);
-        arr.push_back(num);
+/*
+ * Benchmarks of binary_tree_sum and of the usual non-reproducible ways to sum.
+ * N is the global number of elements, all ranks of MPI_COMM_WORLD hold their
+ * slice of them, so the suite can also be run under mpirun. Every iteration
+ * starts after a barrier and takes as long as the slowest rank, which keeps
+ * the numbers of iterations equal on all ranks. Only rank 0 reports.
+ */
 
+constexpr int64_t MIN_ELEMENTS = 1000;
+constexpr int64_t MAX_ELEMENTS = 1000000000;
+
+const std::vector<int64_t> KERNELS = {
+    static_cast<int64_t>(SimdKernel::Scalar),
+    static_cast<int64_t>(SimdKernel::SSE2),
+    static_cast<int64_t>(SimdKernel::AVX),
+    static_cast<int64_t>(SimdKernel::AVX512),
+    static_cast<int64_t>(SimdKernel::NEON),
+};
+
+/*
+ * Local elements of the rank under distribution. Only the slice of the last
+ * benchmark is kept, so the largest N fits into memory once.
+ */
+static const std::vector<double> &local_data(const Distribution &distribution) {
+    static std::vector<double> data;
+    static uint64_t begin = UINT64_MAX;
+    static uint64_t end = UINT64_MAX;
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (distribution.begin(rank) != begin || distribution.end(rank) != end) {
+        begin = distribution.begin(rank);
+        end = distribution.end(rank);
+        data.clear();
+        data.shrink_to_fit();
+        data.resize(end - begin);
+        for (uint64_t i = begin; i < end; i++) {
+            data[i - begin] = element(i);
+        }
     }
-    
+    return data;
+}
 
-    double result = -1.0f;
+static int comm_size() {
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return size;
+}
+
+/*
+ * Time sum() over the state. Every iteration takes as long as the slowest rank.
+ */
+template <typename F>
+static void run(benchmark::State &state, const uint64_t N, F &&sum) {
     for (auto _ : state) {
-        std::vector<double> copy_arr(arr);
+        MPI_Barrier(MPI_COMM_WORLD);
+        const double start = MPI_Wtime();
+        benchmark::DoNotOptimize(sum());
+        double elapsed = MPI_Wtime() - start;
+        MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        state.SetIterationTime(elapsed);
+    }
 
-        double result2 = binary_tree_sum(copy_arr.data(), arr.size());
+    state.SetItemsProcessed(state.iterations() * N);
+    state.SetBytesProcessed(state.iterations() * N * sizeof(double));
+    state.counters["ranks"] = comm_size();
+}
 
-        if (result == -1.0f) {
-            result = result2;
-        } else {
-            assert(result == result2);
-        }
+/*
+ * Arguments: N, SimdKernel, local threads (0 is the OpenMP default), whether
+ * the rank boundaries are aligned by aligned_distribution. On a single rank
+ * both distributions are the same.
+ */
+static void BM_binaryTreeSum(benchmark::State &state) {
+    const uint64_t N = state.range(0);
+    const SimdKernel kernel = static_cast<SimdKernel>(state.range(1));
+    const int threads = state.range(2);
+    const bool aligned = state.range(3);
+
+    if (!set_simd_kernel(kernel)) {
+        state.SkipWithError("SIMD kernel not supported by the CPU");
+        return;
+    }
+    set_local_threads(threads);
+
+    const Distribution distribution = aligned ? aligned_distribution(N, comm_size(), 0.01)
+        : Distribution(N, comm_size());
+    const std::vector<double> &data = local_data(distribution);
+
+    ReductionPlan plan(distribution, MPI_COMM_WORLD, 0, ResultMode::AllRanks, false);
+    BinaryTreeSumWorkspace workspace(data.size());
+    const double expected = binary_tree_sum(data.data(), plan, workspace);
+
+    run(state, N, [&] {
+        [[maybe_unused]] const double result = binary_tree_sum(data.data(), plan, workspace);
+        assert(std::memcmp(&result, &expected, sizeof(double)) == 0);
+        return result;
+    });
+
+    state.counters["messages"] = message_count(distribution);
+    set_simd_kernel(SimdKernel::Auto);
+    set_local_threads(0);
+}
+BENCHMARK(BM_binaryTreeSum)
+    ->ArgNames({"N", "kernel", "threads", "aligned"})
+    ->ArgsProduct({benchmark::CreateRange(MIN_ELEMENTS, MAX_ELEMENTS, 10),
+            {static_cast<int64_t>(SimdKernel::Auto)}, {0}, {0, 1}})
+    ->ArgsProduct({{1000000, 100000000}, KERNELS, {0}, {0}})
+    ->ArgsProduct({{1000000, 100000000}, {static_cast<int64_t>(SimdKernel::Auto)},
+            {1, 2, 4, 8, 16, 32}, {0}})
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+
+/*
+ * binary_tree_sum_fixed of the first N elements on each rank, which does not
+ * communicate, so the iterations are not synchronised.
+ */
+template <size_t N>
+static void BM_binaryTreeSumFixed(benchmark::State &state) {
+    std::vector<double> data(N);
+    for (uint64_t i = 0; i < N; i++) {
+        data[i] = element(i);
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(binary_tree_sum_fixed<N>(data.data()));
     }
+    state.SetItemsProcessed(state.iterations() * N);
+    state.SetBytesProcessed(state.iterations() * N * sizeof(double));
+}
+BENCHMARK_TEMPLATE(BM_binaryTreeSumFixed, 16);
+BENCHMARK_TEMPLATE(BM_binaryTreeSumFixed, 100);
+BENCHMARK_TEMPLATE(BM_binaryTreeSumFixed, 1000);
+BENCHMARK_TEMPLATE(BM_binaryTreeSumFixed, 4096);
+
+/*
+ * Baseline: the local elements summed from left to right, the result of a
+ * single rank only.
+ */
+static void BM_accumulate(benchmark::State &state) {
+    const uint64_t N = state.range(0);
+    const std::vector<double> &data = local_data(Distribution(N, comm_size()));
+
+    run(state, N, [&] {
+        return std::accumulate(data.begin(), data.end(), 0.0);
+    });
 }
-BENCHMARK(BM_randomAdditionSingleRank);
+BENCHMARK(BM_accumulate)
+    ->ArgName("N")
+    ->RangeMultiplier(10)->Range(MIN_ELEMENTS, MAX_ELEMENTS)
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+
+/*
+ * Baseline: Kahan summation of the local elements, the result of a single
+ * rank only.
+ */
+static void BM_kahan(benchmark::State &state) {
+    const uint64_t N = state.range(0);
+    const std::vector<double> &data = local_data(Distribution(N, comm_size()));
+
+    run(state, N, [&] {
+        double sum = 0.0;
+        double compensation = 0.0;
+        for (const double x : data) {
+            const double y = x - compensation;
+            const double t = sum + y;
+            compensation = (t - sum) - y;
+            sum = t;
+        }
+        return sum;
+    });
+}
+BENCHMARK(BM_kahan)
+    ->ArgName("N")
+    ->RangeMultiplier(10)->Range(MIN_ELEMENTS, MAX_ELEMENTS)
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+
+/*
+ * Baseline: std::accumulate on every rank followed by a reduction of the
+ * partial sums to all ranks by MPI, which is not reproducible across rank
+ * counts.
+ */
+static void BM_mpiReduce(benchmark::State &state) {
+    const uint64_t N = state.range(0);
+    const std::vector<double> &data = local_data(Distribution(N, comm_size()));
 
-BENCHMARK_MAIN();
+    run(state, N, [&] {
+        const double localSum = std::accumulate(data.begin(), data.end(), 0.0);
+        double sum;
+        MPI_Allreduce(&localSum, &sum, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        return sum;
+    });
+}
+BENCHMARK(BM_mpiReduce)
+    ->ArgName("N")
+    ->RangeMultiplier(10)->Range(MIN_ELEMENTS, MAX_ELEMENTS)
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+
+/*
+ * Reporter of the ranks other than 0.
+ */
+class NullReporter : public benchmark::BenchmarkReporter {
+public:
+    bool ReportContext(const Context &) override { return true; }
+    void ReportRuns(const std::vector<Run> &) override {}
+};
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    // Only rank 0 writes the --benchmark_out file
+    if (rank != 0) {
+        argc = std::remove_if(argv + 1, argv + argc, [](const char *arg) {
+            return std::strncmp(arg, "--benchmark_out", 15) == 0;
+        }) - argv;
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (rank == 0) {
+        benchmark::RunSpecifiedBenchmarks();
+    } else {
+        NullReporter reporter;
+        benchmark::RunSpecifiedBenchmarks(&reporter);
+    }
+    benchmark::Shutdown();
+
+    MPI_Finalize();
+    return 0;
+}
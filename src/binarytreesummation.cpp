@@ -4,9 +4,20 @@
 #include <cassert>
 #include <cmath>
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <atomic>
+#include <thread>
+#include <future>
 #include "binarytreesummation.h"
+#include "kernels.h"
+#include "instrumentation.h"
 #include <mpi.h>
-#include <immintrin.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 
 const uint64_t parent_index(const uint64_t i) {
@@ -37,7 +48,7 @@ const int rankFromIndex(const uint64_t index, const size_t N, const int p) {
 
     // first rank which has floor(N / p) + 1 elements
     const int remainderRank = p - elementsPerRank.rem;
-    const int remainderRankIndex = remainderRank * elementsPerRank.quot;
+    const uint64_t remainderRankIndex = static_cast<uint64_t>(remainderRank) * elementsPerRank.quot;
 
     if (index < remainderRankIndex) {
         // index is on ranks with floor(N / p) elements, simply divide out.
@@ -53,31 +64,475 @@ const uint64_t startIndex(const int rank, const size_t N, const int p) {
 
     // first rank which has floor(N / p) + 1 elements
     const int remainderRank = p - elementsPerRank.rem;
-    const int remainderRankIndex = remainderRank * elementsPerRank.quot;
+    const uint64_t remainderRankIndex = static_cast<uint64_t>(remainderRank) * elementsPerRank.quot;
 
     if (rank < remainderRank) {
-        return rank * elementsPerRank.quot;
+        return static_cast<uint64_t>(rank) * elementsPerRank.quot;
     } else {
         return remainderRankIndex + (rank - remainderRank) * (elementsPerRank.quot + 1);
     }
 }
 
 
-inline const double sum_remaining_8tree(const uint64_t bufferStartIndex,
+/*
+ * A slot of the shared memory window holds the K values of one summand. The
+ * sender stores the number of the reduction the values belong to in the
+ * sequence field after writing them, the receiver stores it in the ack field
+ * after reading them, so the next reduction does not overwrite them early.
+ */
+constexpr size_t CACHE_LINE = 64;
+
+size_t slot_bytes(const size_t valueBytes) {
+    return 2 * CACHE_LINE + (valueBytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+std::atomic_ref<uint64_t> slot_sequence(char *slot) {
+    return std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t *>(slot));
+}
+
+std::atomic_ref<uint64_t> slot_ack(char *slot) {
+    return std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t *>(slot + CACHE_LINE));
+}
+
+char *slot_values(char *slot) {
+    return slot + 2 * CACHE_LINE;
+}
+
+/*
+ * Wait until the field reaches value. Yields after a short spin, ranks of a
+ * node may share cores.
+ */
+void wait_for(const std::atomic_ref<uint64_t> field, const uint64_t value) {
+    for (int spins = 0; field.load(std::memory_order_acquire) < value; spins++) {
+        if (spins > 1000) std::this_thread::yield();
+    }
+}
+
+template <typename T>
+MPI_Datatype mpi_datatype();
+
+template <>
+MPI_Datatype mpi_datatype<float>() {
+    return MPI_FLOAT;
+}
+
+template <>
+MPI_Datatype mpi_datatype<double>() {
+    return MPI_DOUBLE;
+}
+
+/**
+ * The messages of one reduction through plan with K lanes of Accumulator.
+ * Construction starts the receives of the partial sums of other ranks that
+ * are needed by the local reduction, they are only waited for at the tree
+ * level where the summand is consumed. The local rank-intersecting summands
+ * are sent one by one as soon as they are complete, finish waits for all
+ * messages.
+ */
+template <typename Accumulator>
+class SummandExchange {
+public:
+    SummandExchange(ReductionPlan &plan, const size_t K) : K(K), plan(plan) {
+        plan.prepare(K, mpi_datatype<Accumulator>());
+        plan.sequence++;
+
+        if (!plan.incomingRequests.empty()) {
+            MPI_Startall(plan.incomingRequests.size(), plan.incomingRequests.data());
+        }
+    }
+
+    /**
+     * Number and global indices of the local rank-intersecting summands.
+     */
+    size_t outgoing_count() const { return plan.outgoingIndices.size(); }
+    uint64_t outgoing_index(const size_t i) const { return plan.outgoingIndices[i]; }
+
+    /**
+     * Buffer of the K values of the i-th local rank-intersecting summand.
+     */
+    Accumulator *outgoing_values(const size_t i) {
+        return reinterpret_cast<Accumulator *>(plan.outgoingValues.data()) + i * K;
+    }
+
+    /**
+     * Send the K values of the i-th local rank-intersecting summand, which have
+     * been written to outgoing_values(i), to the rank of its parent.
+     */
+    void send(const size_t i) {
+        INSTRUMENT_PHASE(sendTime);
+        INSTRUMENT_COUNT(messagesSent, 1);
+        INSTRUMENT_COUNT(bytesSent, K * plan.valueSize);
+        char *slot = plan.outgoingSlots.empty() ? nullptr : plan.outgoingSlots[i];
+        if (slot != nullptr) {
+            const size_t valueBytes = K * plan.valueSize;
+            wait_for(slot_ack(slot), plan.sequence - 1);
+            std::memcpy(slot_values(slot), &plan.outgoingValues[i * valueBytes], valueBytes);
+            slot_sequence(slot).store(plan.sequence, std::memory_order_release);
+        } else {
+            MPI_Start(&plan.outgoingRequests[i]);
+        }
+    }
+
+    /**
+     * Wait for the summand with the given global index and return its K values.
+     */
+    const Accumulator *wait(const uint64_t index) {
+        INSTRUMENT_PHASE(receiveWaitTime);
+        INSTRUMENT_COUNT(messagesReceived, 1);
+        INSTRUMENT_COUNT(bytesReceived, K * sizeof(Accumulator));
+        const auto &indices = plan.incomingIndices;
+        const auto it = std::lower_bound(indices.begin(), indices.end(), index);
+        assert(it != indices.end() && *it == index);
+        const size_t i = it - indices.begin();
+
+        Accumulator *values = reinterpret_cast<Accumulator *>(plan.incomingValues.data()) + i * K;
+        char *slot = plan.incomingSlots.empty() ? nullptr : plan.incomingSlots[i];
+        if (slot != nullptr) {
+            wait_for(slot_sequence(slot), plan.sequence);
+            std::memcpy(values, slot_values(slot), K * sizeof(Accumulator));
+            slot_ack(slot).store(plan.sequence, std::memory_order_release);
+        } else {
+            MPI_Wait(&plan.incomingRequests[plan.incomingRequestIndices[i]], MPI_STATUS_IGNORE);
+        }
+        return values;
+    }
+
+    /**
+     * This rank holds index 0 and computes the result. Without elements no
+     * rank does, the result of 0 is broadcast from the root all the same.
+     */
+    bool is_root() const { return plan.rank == plan.rootRank && plan.N > 0; }
+
+    /**
+     * Wait until all messages of the reduction completed and distribute the K
+     * results of the root to the ranks selected by plan.resultMode. If request
+     * is not null, the broadcast does not block and request is set to it.
+     */
+    void finish(Accumulator *results, MPI_Request *request = nullptr) {
+        MPI_Waitall(plan.outgoingRequests.size(), plan.outgoingRequests.data(), MPI_STATUSES_IGNORE);
+        MPI_Waitall(plan.incomingRequests.size(), plan.incomingRequests.data(), MPI_STATUSES_IGNORE);
+
+        // A single rank already holds the result
+        if (plan.resultMode == ResultMode::RootOnly || plan.clusterSize == 1) {
+            if (request != nullptr) *request = MPI_REQUEST_NULL;
+        } else if (request != nullptr) {
+            MPI_Ibcast(results, K, mpi_datatype<Accumulator>(), plan.rootRank, plan.comm, request);
+        } else {
+            MPI_Bcast(results, K, mpi_datatype<Accumulator>(), plan.rootRank, plan.comm);
+        }
+    }
+
+    const size_t K;
+
+private:
+    ReductionPlan &plan;
+};
+
+Distribution::Distribution(const size_t N, const int p) : offsets(p + 1) {
+    for (int rank = 0; rank <= p; rank++) {
+        offsets[rank] = startIndex(rank, N, p);
+    }
+}
+
+Distribution::Distribution(std::vector<uint64_t> offsets) : offsets(std::move(offsets)) {
+    assert(this->offsets.size() >= 2 && this->offsets.front() == 0);
+    assert(std::is_sorted(this->offsets.begin(), this->offsets.end()));
+}
+
+uint64_t Distribution::size() const {
+    return offsets.back();
+}
+
+int Distribution::ranks() const {
+    return offsets.size() - 1;
+}
+
+uint64_t Distribution::begin(const int rank) const {
+    return offsets[rank];
+}
+
+uint64_t Distribution::end(const int rank) const {
+    return offsets[rank + 1];
+}
+
+int Distribution::rank_of(const uint64_t index) const {
+    assert(index < size());
+    // Last rank starting at or before index, this skips ranks without elements
+    const auto it = std::upper_bound(offsets.begin(), offsets.end(), index);
+    return it - offsets.begin() - 1;
+}
+
+Distribution aligned_distribution(const size_t N, const int p, const double tolerance) {
+    // Negative and NaN tolerances keep the even distribution
+    const uint64_t slack = (tolerance > 0.0) ? std::min<double>(N, tolerance * N / (2 * p)) : 0;
+
+    std::vector<uint64_t> offsets(p + 1);
+    offsets[p] = N;
+    for (int rank = 1; rank < p; rank++) {
+        const uint64_t ideal = startIndex(rank, N, p);
+        const uint64_t low = std::max(offsets[rank - 1], ideal - std::min(ideal, slack));
+        const uint64_t high = std::min<uint64_t>(N, ideal + slack);
+
+        // Positive multiple of the largest power of two within [low, high],
+        // index 0 would empty all ranks before this one
+        offsets[rank] = std::max(ideal, low);
+        for (int k = 63; k > 0; k--) {
+            const uint64_t alignment = 1UL << k;
+            const uint64_t candidate = std::max(alignment, (low + alignment - 1) & ~(alignment - 1));
+            if (candidate >= low && candidate <= high) {
+                offsets[rank] = candidate;
+                break;
+            }
+        }
+    }
+
+    return Distribution(std::move(offsets));
+}
+
+uint64_t message_count(const Distribution &distribution) {
+    uint64_t messages = 0;
+
+    for (int rank = 0; rank < distribution.ranks(); rank++) {
+        const uint64_t end = distribution.end(rank);
+        for (uint64_t idx = distribution.begin(rank); idx != 0 && idx < end;
+                idx = next_rank_intersecting_summand(idx)) {
+            messages++;
+        }
+    }
+
+    return messages;
+}
+
+int comm_size(MPI_Comm comm) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    return size;
+}
+
+/*
+ * Determine the rank-intersecting summands from the local index range
+ * and rankOf(index), the owner of a global index, and beginOf(rank), the
+ * first index of a rank. Only O(log N) indices are visited, each looked up
+ * once, so the cost does not grow with the number of ranks.
+ */
+template <typename RankOf, typename BeginOf>
+void ReductionPlan::find_summands(RankOf rankOf, BeginOf beginOf) {
+    // The first ranks may hold no elements, the root is the owner of index 0.
+    // Without elements rank 0 is the root and the result is 0.
+    rootRank = (N == 0) ? 0 : rankOf(0);
+
+    // Rank-intersecting summands on ranks > 0
+    for (uint64_t idx = beginIdx; idx != 0 && idx < endIdx;
+            idx = next_rank_intersecting_summand(idx)) {
+        outgoingIndices.push_back(idx);
+        outgoingRanks.push_back(rankOf(parent_index(idx)));
+    }
+
+    // Summands of higher ranks whose parent is located here. They start at
+    // endIdx or at one of the following rank-intersecting indices, whose
+    // parents lie before endIdx and decrease along the chain.
+    for (uint64_t idx = endIdx; beginIdx < endIdx && idx < N
+            && parent_index(idx) >= beginIdx; idx = next_rank_intersecting_summand(idx)) {
+        const int sourceRank = rankOf(idx);
+        size_t position = 0;
+        for (uint64_t i = beginOf(sourceRank); i != idx; i = next_rank_intersecting_summand(i)) {
+            position++;
+        }
+        incomingIndices.push_back(idx);
+        incomingRanks.push_back(sourceRank);
+        incomingSlotIndices.push_back(position);
+    }
+}
+
+/*
+ * Translate the peers to ranks of its node communicator.
+ */
+void ReductionPlan::find_node_ranks() {
+    outgoingNodeRanks.assign(outgoingRanks.size(), -1);
+    incomingNodeRanks.assign(incomingRanks.size(), -1);
+    if (!hierarchical) return;
+
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+
+    MPI_Group group, nodeGroup;
+    MPI_Comm_group(comm, &group);
+    MPI_Comm_group(nodeComm, &nodeGroup);
+    MPI_Group_translate_ranks(group, outgoingRanks.size(), outgoingRanks.data(),
+            nodeGroup, outgoingNodeRanks.data());
+    MPI_Group_translate_ranks(group, incomingRanks.size(), incomingRanks.data(),
+            nodeGroup, incomingNodeRanks.data());
+    MPI_Group_free(&group);
+    MPI_Group_free(&nodeGroup);
+
+    for (auto &nodeRank : outgoingNodeRanks) {
+        if (nodeRank == MPI_UNDEFINED) nodeRank = -1;
+    }
+    for (auto &nodeRank : incomingNodeRanks) {
+        if (nodeRank == MPI_UNDEFINED) nodeRank = -1;
+    }
+}
+
+ReductionPlan::ReductionPlan(const size_t N, MPI_Comm comm, const int tag,
+        const ResultMode resultMode, const bool hierarchical)
+    : N(N), comm(comm), tag(tag), resultMode(resultMode), hierarchical(hierarchical) {
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &clusterSize);
+
+    // "even_remainder_at_end" in closed form, without the offsets of all ranks
+    const int p = clusterSize;
+    beginIdx = startIndex(rank, N, p);
+    endIdx = startIndex(rank + 1, N, p);
+    find_summands([N, p](const uint64_t index) { return rankFromIndex(index, N, p); },
+            [N, p](const int rank) { return startIndex(rank, N, p); });
+    find_node_ranks();
+}
+
+ReductionPlan::ReductionPlan(const Distribution &distribution, MPI_Comm comm, const int tag,
+        const ResultMode resultMode, const bool hierarchical)
+    : N(distribution.size()), comm(comm), tag(tag), resultMode(resultMode), hierarchical(hierarchical) {
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &clusterSize);
+    assert(distribution.ranks() == clusterSize);
+
+    beginIdx = distribution.begin(rank);
+    endIdx = distribution.end(rank);
+    find_summands([&](const uint64_t index) { return distribution.rank_of(index); },
+            [&](const int rank) { return distribution.begin(rank); });
+    find_node_ranks();
+}
+
+/*
+ * Free the requests and the shared memory window set up by prepare.
+ */
+void ReductionPlan::free_communication() {
+    for (auto &request : outgoingRequests) {
+        if (request != MPI_REQUEST_NULL) MPI_Request_free(&request);
+    }
+    for (auto &request : incomingRequests) {
+        if (request != MPI_REQUEST_NULL) MPI_Request_free(&request);
+    }
+
+    if (window != MPI_WIN_NULL) {
+        MPI_Win_unlock_all(window);
+        MPI_Win_free(&window);
+    }
+}
+
+ReductionPlan::~ReductionPlan() {
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (finalized) return;
+
+    free_communication();
+    if (nodeComm != MPI_COMM_NULL) {
+        MPI_Comm_free(&nodeComm);
+    }
+}
+
+void ReductionPlan::prepare(const size_t K, MPI_Datatype valueType) {
+    if (K == lanes && valueType == this->valueType) return;
+
+    free_communication();
+
+    lanes = K;
+    this->valueType = valueType;
+    MPI_Type_size(valueType, &valueSize);
+    const size_t valueBytes = K * valueSize;
+
+    outgoingValues.resize(valueBytes * outgoingIndices.size());
+    outgoingRequests.assign(outgoingIndices.size(), MPI_REQUEST_NULL);
+    incomingValues.resize(valueBytes * incomingIndices.size());
+    incomingRequests.clear();
+    incomingRequestIndices.assign(incomingIndices.size(), 0);
+
+    for (size_t i = 0; i < outgoingIndices.size(); i++) {
+        if (outgoingNodeRanks[i] >= 0) continue;
+        MPI_Send_init(&outgoingValues[i * valueBytes], K, valueType, outgoingRanks[i],
+                tag, comm, &outgoingRequests[i]);
+    }
+
+    for (size_t i = 0; i < incomingIndices.size(); i++) {
+        if (incomingNodeRanks[i] >= 0) continue;
+        // Messages from one rank are matched in the order they were sent,
+        // which is ascending by index like the receives started here.
+        incomingRequestIndices[i] = incomingRequests.size();
+        incomingRequests.emplace_back();
+        MPI_Recv_init(&incomingValues[i * valueBytes], K, valueType, incomingRanks[i],
+                tag, comm, &incomingRequests.back());
+    }
+
+    if (hierarchical) {
+        // Every rank owns the slots of its own rank-intersecting summands
+        const size_t slotBytes = slot_bytes(valueBytes);
+        MPI_Info info;
+        MPI_Info_create(&info);
+        MPI_Info_set(info, "alloc_shared_noncontig", "true");
+
+        char *segment;
+        MPI_Win_allocate_shared(slotBytes * outgoingIndices.size(), 1, info, nodeComm,
+                &segment, &window);
+        MPI_Info_free(&info);
+
+        std::fill(segment, segment + slotBytes * outgoingIndices.size(), 0);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+        sequence = 0;
+
+        outgoingSlots.assign(outgoingIndices.size(), nullptr);
+        for (size_t i = 0; i < outgoingIndices.size(); i++) {
+            if (outgoingNodeRanks[i] >= 0) outgoingSlots[i] = segment + i * slotBytes;
+        }
+
+        incomingSlots.assign(incomingIndices.size(), nullptr);
+        for (size_t i = 0; i < incomingIndices.size(); i++) {
+            if (incomingNodeRanks[i] < 0) continue;
+            MPI_Aint size;
+            int displacementUnit;
+            char *senderSegment;
+            MPI_Win_shared_query(window, incomingNodeRanks[i], &size, &displacementUnit, &senderSegment);
+            incomingSlots[i] = senderSegment + incomingSlotIndices[i] * slotBytes;
+        }
+
+        // No rank may look at a slot before its owner cleared it
+        MPI_Barrier(nodeComm);
+    }
+}
+
+/**
+ * Sum the remaining elements after the last complete block of 8 in up to three
+ * tree levels. The elements of lane k start at srcBuffers[k] + srcOffset, the
+ * partial sums are written to dstBuffers[k] + dstOffset. All K lanes are
+ * processed together, a summand missing from another rank arrives as K values
+ * through incoming.
+ */
+template <typename Input, typename Accumulator>
+inline void sum_remaining_8tree(const uint64_t bufferStartIndex,
         const uint64_t initialRemainingElements,
         const int y,
         const uint64_t maxX,
-        double *srcBuffer,
-        double *dstBuffer,
-        const uint64_t N,
-        int p) {
+        const Input *const *srcBuffers,
+        const uint64_t srcOffset,
+        Accumulator *const *dstBuffers,
+        const uint64_t dstOffset,
+        const size_t K,
+        Accumulator *results,
+        SummandExchange<Accumulator> &incoming) {
     uint64_t remainingElements = initialRemainingElements;
 
+    // Elements of the current level, the first level is read from the source
+    auto element = [&](const int level, const size_t k, const uint64_t i) -> Accumulator {
+        return (level == 0) ? Accumulator(srcBuffers[k][srcOffset + i]) : dstBuffers[k][dstOffset + i];
+    };
+
     for (int level = 0; level < 3; level++) {
         const int stride = 1 << (y - 1 + level);
         int elementsWritten = 0;
-        for (int i = 0; (i + 1) < remainingElements; i += 2) {
-            dstBuffer[elementsWritten++] = srcBuffer[i] + srcBuffer[i + 1];
+
+        for (size_t k = 0; k < K; k++) {
+            Accumulator *dstBuffer = dstBuffers[k] + dstOffset;
+            elementsWritten = 0;
+            for (uint64_t i = 0; (i + 1) < remainingElements; i += 2) {
+                dstBuffer[elementsWritten++] = element(level, k, i) + element(level, k, i + 1);
+            }
         }
 
 
@@ -85,120 +540,934 @@ inline const double sum_remaining_8tree(const uint64_t bufferStartIndex,
             const uint64_t bufferIndexA = remainingElements - 1;
             const uint64_t bufferIndexB = remainingElements;
             const uint64_t indexB = bufferStartIndex + bufferIndexB * stride;
-            const double a = srcBuffer[bufferIndexA];
 
             if (indexB > maxX) {
                 // indexB is the last element because the subtree ends there
-                dstBuffer[elementsWritten++] = a;
+                for (size_t k = 0; k < K; k++) {
+                    dstBuffers[k][dstOffset + elementsWritten] = element(level, k, bufferIndexA);
+                }
             } else {
                 // indexB must be fetched from another rank
-                const int sourceRank = rankFromIndex(indexB, N, p);
-                double b;
-                MPI_Recv(&b, 1, MPI_DOUBLE, sourceRank, 0, MPI_COMM_WORLD, NULL);
-                dstBuffer[elementsWritten++] = a + b;
+                const Accumulator *recvBuffer = incoming.wait(indexB);
+                for (size_t k = 0; k < K; k++) {
+                    dstBuffers[k][dstOffset + elementsWritten] = element(level, k, bufferIndexA) + recvBuffer[k];
+                }
             }
+            elementsWritten++;
 
             remainingElements += 1;
         }
 
-    srcBuffer = dstBuffer;
         remainingElements /= 2;
     }
     assert(remainingElements == 1);
 
-    return dstBuffer[0];
+    for (size_t k = 0; k < K; k++) {
+        results[k] = dstBuffers[k][dstOffset];
+    }
+}
+
+#ifdef _OPENMP
+static int localThreads = omp_get_max_threads();
+#else
+static int localThreads = 1;
+#endif
+
+extern void set_local_threads(const int threads) {
+#ifdef _OPENMP
+    localThreads = (threads > 0) ? threads : omp_get_max_threads();
+#endif
+}
+
+extern int get_local_threads() {
+    return localThreads;
+}
+
+#ifdef BINARY_TREE_SUMMATION_STATS
+thread_local SumStatistics sumStatistics;
+
+extern SumStatistics get_sum_statistics() {
+    return sumStatistics;
+}
+
+extern void reset_sum_statistics() {
+    sumStatistics = SumStatistics();
+}
+#else
+extern SumStatistics get_sum_statistics() {
+    return SumStatistics();
+}
+
+extern void reset_sum_statistics() {
+}
+#endif
+
+static SimdKernel activeKernel = best_simd_kernel();
+
+/*
+ * Implementation of activeKernel for the given element types.
+ */
+template <typename Input, typename Accumulator>
+sum_8blocks_kernel<Input, Accumulator> &sum_8blocks() {
+    static sum_8blocks_kernel<Input, Accumulator> implementation =
+        select_sum_8blocks_kernel<Input, Accumulator>(activeKernel);
+    return implementation;
+}
+
+extern bool set_simd_kernel(const SimdKernel kernel) {
+    // A kernel is available for all element types or none
+    if (select_sum_8blocks_kernel<double, double>(kernel) == nullptr) return false;
+
+    activeKernel = (kernel == SimdKernel::Auto) ? best_simd_kernel() : kernel;
+    sum_8blocks<double, double>() = select_sum_8blocks_kernel<double, double>(activeKernel);
+    sum_8blocks<float, double>() = select_sum_8blocks_kernel<float, double>(activeKernel);
+    sum_8blocks<float, float>() = select_sum_8blocks_kernel<float, float>(activeKernel);
+    return true;
+}
+
+extern SimdKernel get_simd_kernel() {
+    return activeKernel;
+}
+
+
+/*
+ * Element-wise transformation of the leaves, see binary_tree_transform_sum.
+ */
+template <typename Input, typename Accumulator>
+struct Transform {
+    ElementTransform<Input, Accumulator> apply;
+    void *context;
+};
+
+/**
+ * Reduce the n elements of the nodes starting at global index index by the
+ * levels y to y + 2 and return the number of partial sums written. The
+ * elements of lane k are read from src[k] + srcOffset, the partial sums are
+ * written to dst[k] + dstOffset.
+ */
+template <typename Input, typename Accumulator>
+uint64_t reduce_pass(const uint64_t index, const uint64_t n,
+        const Input *const *src, const uint64_t srcOffset,
+        Accumulator *const *dst, const uint64_t dstOffset,
+        const int y, const uint64_t maxX,
+        const size_t K, Accumulator *results, SummandExchange<Accumulator> &incoming) {
+    uint64_t elementsWritten = 0;
+
+    const auto kernel = sum_8blocks<Input, Accumulator>();
+    for (size_t k = 0; k < K; k++) {
+        elementsWritten = kernel(src[k] + srcOffset, dst[k] + dstOffset, n);
+    }
+
+    // number of remaining elements
+    const uint64_t remainder = n - 8 * elementsWritten;
+    assert(0 <= remainder);
+    assert(remainder < 8);
+
+    if (remainder > 0) {
+        const uint64_t bufferIdx = 8 * elementsWritten;
+        const uint64_t indexOfRemainingTree = index + bufferIdx * (1UL << (y - 1));
+        sum_remaining_8tree(indexOfRemainingTree,
+                remainder, y, maxX,
+                src, srcOffset + bufferIdx, dst, dstOffset + elementsWritten, K,
+                results, incoming);
+        for (size_t k = 0; k < K; k++) {
+            dst[k][dstOffset + elementsWritten] = results[k];
+        }
+        elementsWritten++;
+    }
+
+    return elementsWritten;
 }
 
+/*
+ * Transformed leaves are produced in chunks of this many elements, small
+ * enough to stay in the L1 cache. A multiple of 8, so that only the last chunk
+ * has an incomplete block.
+ */
+constexpr uint64_t TRANSFORM_CHUNK = 1024;
 
+/**
+ * Same as reduce_pass, but the elements are transformed chunk by chunk into
+ * scratch memory before they are reduced.
+ */
+template <typename Input, typename Accumulator>
+uint64_t reduce_transformed_pass(const uint64_t index, const uint64_t n,
+        const Input *const *src, const uint64_t srcOffset,
+        Accumulator *const *dst, const uint64_t dstOffset,
+        const int y, const uint64_t maxX,
+        const size_t K, Accumulator *results, SummandExchange<Accumulator> &incoming,
+        const Transform<Input, Accumulator> &transform) {
+    static thread_local std::vector<Accumulator> chunk;
+    static thread_local std::vector<const Accumulator *> chunkLanes;
+    chunk.resize(K * TRANSFORM_CHUNK);
+    chunkLanes.resize(K);
+
+    uint64_t elementsWritten = 0;
+    for (uint64_t i = 0; i < n; i += TRANSFORM_CHUNK) {
+        const uint64_t chunkElements = std::min(TRANSFORM_CHUNK, n - i);
+        for (size_t k = 0; k < K; k++) {
+            chunkLanes[k] = &chunk[k * TRANSFORM_CHUNK];
+            transform.apply(src[k] + srcOffset + i, &chunk[k * TRANSFORM_CHUNK], chunkElements,
+                    transform.context);
+        }
+        elementsWritten += reduce_pass(index + i * (1UL << (y - 1)), chunkElements,
+                chunkLanes.data(), 0, dst, dstOffset + elementsWritten, y, maxX, K, results, incoming);
+    }
 
-double accumulate(const uint64_t index, double *data, const uint64_t N, const int p, const uint64_t begin, const uint64_t end) {
+    return elementsWritten;
+}
+
+/**
+ * Reduce the n elements of the tree levels below firstY of the nodes starting
+ * at global index index by the levels firstY to lastY, three levels per pass
+ * over the buffer. The elements of lane k are read from src[k] + srcOffset,
+ * and transformed by transform if given, the partial sums are written to
+ * dst[k] + dstOffset. Return the number of partial sums left after level lastY.
+ */
+template <typename Input, typename Accumulator>
+uint64_t reduce_levels(const uint64_t index, const uint64_t n,
+        const Input *const *src, const uint64_t srcOffset,
+        Accumulator *const *dst, const uint64_t dstOffset,
+        const int firstY, const int lastY, const uint64_t maxX,
+        const size_t K, Accumulator *results, SummandExchange<Accumulator> &incoming,
+        const Transform<Input, Accumulator> *transform = nullptr) {
+    uint64_t elementsInBuffer = n;
+
+    for (int y = firstY; y <= lastY; y += 3) {
+        // The first pass reads the source, the following ones the partial sums
+        if (y == firstY && transform != nullptr) {
+            elementsInBuffer = reduce_transformed_pass(index, elementsInBuffer, src, srcOffset,
+                    dst, dstOffset, y, maxX, K, results, incoming, *transform);
+        } else if (y == firstY) {
+            elementsInBuffer = reduce_pass(index, elementsInBuffer, src, srcOffset,
+                    dst, dstOffset, y, maxX, K, results, incoming);
+        } else {
+            elementsInBuffer = reduce_pass(index, elementsInBuffer, dst, dstOffset,
+                    dst, dstOffset, y, maxX, K, results, incoming);
+        }
+    }
+
+    return elementsInBuffer;
+}
+
+/*
+ * Subtrees of 2^BLOCK_LEVELS elements are reduced to a single value one at a
+ * time per thread, so their partial sums stay in cache and the input is
+ * streamed from memory only once. BLOCK_LEVELS is a multiple of three to keep the levels
+ * of the passes aligned with the unblocked reduction.
+ */
+constexpr int BLOCK_LEVELS = 15;
+constexpr uint64_t BLOCK_SIZE = 1UL << BLOCK_LEVELS;
+
+/**
+ * Sum the subtree rooted at index for K lanes and store the sums in results.
+ * The leaves of lane k are read from data[k], the partial sums of every level
+ * are written to buffer[k] which may alias data[k] (in-place reduction).
+ * Otherwise buffer[k] must hold at least floor(n / 8) + 4 elements where n is
+ * the number of local elements of the subtree. If transform is given, the
+ * leaves are transformed before they are summed.
+ */
+template <typename Input, typename Accumulator>
+void accumulate(const uint64_t index, const Input *const *data, Accumulator *const *buffer,
+        const size_t K, Accumulator *results, SummandExchange<Accumulator> &incoming,
+        const uint64_t N, const uint64_t begin, const uint64_t end,
+        const Transform<Input, Accumulator> *transform = nullptr) {
+    // Value of a single leaf
+    auto leaf = [&](const size_t k, const uint64_t i) -> Accumulator {
+        if (transform == nullptr) return data[k][i];
+
+        Accumulator value;
+        transform->apply(&data[k][i], &value, 1, transform->context);
+        return value;
+    };
 
     if (index & 1) {
-        return data[index - begin];
+        for (size_t k = 0; k < K; k++) {
+            results[k] = leaf(k, index - begin);
+        }
+        return;
     }
 
     const uint64_t maxX = (index == 0) ? N - 1
         : std::min(N - 1, index + subtree_size(index) - 1);
     const int maxY = (index == 0) ? ceil(log2(N)) : log2(subtree_size(index));
 
+    if (maxY == 0) {
+        // Tree consists of a single element
+        for (size_t k = 0; k < K; k++) {
+            results[k] = leaf(k, 0);
+        }
+        return;
+    }
+
     const uint64_t largest_local_index = std::min(maxX, end - 1);
     const uint64_t n_local_elements = largest_local_index + 1 - index;
 
-    uint64_t elementsInBuffer = n_local_elements;
+    if (maxY <= BLOCK_LEVELS || n_local_elements < 2 * BLOCK_SIZE) {
+        [[maybe_unused]] const uint64_t elementsInBuffer = reduce_levels(index, n_local_elements,
+                data, 0, buffer, 0, 1, maxY, maxX, K, results, incoming, transform);
+        assert(elementsInBuffer == 1);
+    } else {
+        // index is a multiple of the subtree size, so every block is a
+        // complete subtree without summands of other ranks. The blocks are
+        // distributed over the threads, each with its own scratch memory
+        // because the input may be reduced in place.
+        const uint64_t fullBlocks = n_local_elements / BLOCK_SIZE;
+        static thread_local std::vector<Accumulator> blockSumsBuffer;
+        blockSumsBuffer.resize(K * fullBlocks);
+        Accumulator *blockSums = blockSumsBuffer.data();
 
-    double *sourceBuffer = data;
-    double *destinationBuffer = data;
+        #pragma omp parallel num_threads(localThreads) if (fullBlocks > 1)
+        {
+            static thread_local std::vector<Accumulator> scratch;
+            static thread_local std::vector<Accumulator *> scratchLanes;
+            static thread_local std::vector<Accumulator> laneResults;
+            scratch.resize(K * (BLOCK_SIZE / 8));
+            scratchLanes.resize(K);
+            laneResults.resize(K);
+            for (size_t k = 0; k < K; k++) {
+                scratchLanes[k] = &scratch[k * (BLOCK_SIZE / 8)];
+            }
+
+            #pragma omp for schedule(static)
+            for (uint64_t j = 0; j < fullBlocks; j++) {
+                [[maybe_unused]] const uint64_t sums = reduce_levels(index + j * BLOCK_SIZE,
+                        BLOCK_SIZE, data, j * BLOCK_SIZE, scratchLanes.data(), 0,
+                        1, BLOCK_LEVELS, maxX, K, laneResults.data(), incoming, transform);
+                assert(sums == 1);
+                for (size_t k = 0; k < K; k++) {
+                    blockSums[k * fullBlocks + j] = scratchLanes[k][0];
+                }
+            }
+        }
 
-    for (int y = 1; y <= maxY; y += 3) {
-        uint64_t elementsWritten = 0;
+        for (size_t k = 0; k < K; k++) {
+            std::copy(&blockSums[k * fullBlocks], &blockSums[(k + 1) * fullBlocks], buffer[k]);
+        }
 
-        for (uint64_t i = 0; i + 8 <= elementsInBuffer; i += 8) {
-            __m256d a = _mm256_loadu_pd(static_cast<double *>(&sourceBuffer[i]));
-            __m256d b = _mm256_loadu_pd(static_cast<double *>(&sourceBuffer[i+4]));
-            __m256d level1Sum = _mm256_hadd_pd(a, b);
+        // The incomplete last block may include summands of other ranks
+        const uint64_t tailElements = n_local_elements - fullBlocks * BLOCK_SIZE;
+        uint64_t elementsInBuffer = fullBlocks;
+        if (tailElements > 0) {
+            elementsInBuffer += reduce_levels(index + fullBlocks * BLOCK_SIZE, tailElements,
+                    data, fullBlocks * BLOCK_SIZE, buffer, fullBlocks,
+                    1, BLOCK_LEVELS, maxX, K, results, incoming, transform);
+        }
+
+        elementsInBuffer = reduce_levels(index, elementsInBuffer, buffer, 0, buffer, 0,
+                BLOCK_LEVELS + 1, maxY, maxX, K, results, incoming);
+        assert(elementsInBuffer == 1);
+    }
+
+    for (size_t k = 0; k < K; k++) {
+        results[k] = buffer[k][0];
+    }
+}
 
-            __m128d c = _mm256_extractf128_pd(level1Sum, 1); // Fetch upper 128bit
-            __m128d d = _mm256_castpd256_pd128(level1Sum); // Fetch lower 128bit
-            __m128d level2Sum = _mm_add_pd(c, d);
+/**
+ * Reduce the local elements of this rank for K lanes, reading from data[k] and
+ * using buffer[k] for the partial sums, see accumulate. If buffer[k] equals
+ * data[k] the lane is reduced in place. If request is not null, the result is
+ * broadcast without blocking and request is set to the pending broadcast.
+ * If transform is given, the leaves are transformed before they are summed.
+ */
+template <typename Input, typename Accumulator>
+void binary_tree_sum(const Input *const *data, Accumulator *const *buffer, const size_t K,
+        Accumulator *results, ReductionPlan &plan, MPI_Request *request = nullptr,
+        const Transform<Input, Accumulator> *transform = nullptr) {
+    INSTRUMENT_PHASE(totalTime);
+    INSTRUMENT_COUNT(calls, 1);
+    const uint64_t N = plan.size();
+    const uint64_t beginIdx = plan.local_begin();
+    const uint64_t endIdx = plan.local_end();
+    SummandExchange<Accumulator> exchange(plan, K);
 
-            __m128d level3Sum = _mm_hadd_pd(level2Sum, level2Sum);
+    static thread_local std::vector<const Input *> laneSources;
+    static thread_local std::vector<Accumulator *> laneDestinations;
+    laneSources.resize(K);
+    laneDestinations.resize(K);
 
-            destinationBuffer[elementsWritten++] = _mm_cvtsd_f64(level3Sum);
+    for (size_t i = 0; i < exchange.outgoing_count(); i++) {
+        const uint64_t idx = exchange.outgoing_index(i);
+        for (size_t k = 0; k < K; k++) {
+            laneSources[k] = data[k] + idx - beginIdx;
+            laneDestinations[k] = buffer[k];
+            if constexpr (std::is_same_v<Input, Accumulator>) {
+                if (buffer[k] == data[k]) laneDestinations[k] = const_cast<Accumulator *>(laneSources[k]);
+            }
         }
+        accumulate(idx, laneSources.data(), laneDestinations.data(), K,
+                exchange.outgoing_values(i), exchange, N, idx, endIdx, transform);
+
+        // Send the partial sum right away and continue with the next summand
+        exchange.send(i);
+    }
+
+    if (exchange.is_root()) {
+        accumulate(0, data, buffer, K, results, exchange, N, 0, endIdx, transform);
+    } else {
+        std::fill(results, results + K, Accumulator(0));
+    }
+
+    INSTRUMENT_PHASE(resultTime);
+    exchange.finish(results, request);
+
+}
+
+/**
+ * Single lane case of the above.
+ */
+template <typename Input, typename Accumulator>
+Accumulator binary_tree_sum(const Input *data, Accumulator *buffer, ReductionPlan &plan) {
+    Accumulator result;
+    binary_tree_sum(&data, &buffer, 1, &result, plan);
+    return result;
+}
+
+extern double binary_tree_sum(double *data, ReductionPlan &plan) {
+    return binary_tree_sum(data, data, plan);
+}
+
+extern double binary_tree_sum(const double *data, ReductionPlan &plan, BinaryTreeSumWorkspace &workspace) {
+    return binary_tree_sum(data, workspace.reserve(plan.local_end() - plan.local_begin()), plan);
+}
+
+extern float binary_tree_sum(float *data, ReductionPlan &plan) {
+    return binary_tree_sum(data, data, plan);
+}
+
+template <typename Accumulator, typename Input>
+Accumulator binary_tree_sum(const Input *data, ReductionPlan &plan, BinaryTreeSumWorkspace &workspace) {
+    return binary_tree_sum(data, workspace.reserve<Accumulator>(plan.local_end() - plan.local_begin()), plan);
+}
+
+template <typename Accumulator, typename Input>
+Accumulator binary_tree_sum(const Input *data, const size_t N, MPI_Comm comm, const int tag) {
+    ReductionPlan plan(N, comm, tag);
+    BinaryTreeSumWorkspace workspace;
+    return binary_tree_sum<Accumulator>(data, plan, workspace);
+}
+
+template <typename Accumulator, typename Input>
+Accumulator binary_tree_transform_sum(const Input *data, ReductionPlan &plan,
+        BinaryTreeSumWorkspace &workspace, ElementTransform<Input, Accumulator> transform,
+        void *context) {
+    const Transform<Input, Accumulator> elementTransform {transform, context};
+    Accumulator *buffer = workspace.reserve<Accumulator>(plan.local_end() - plan.local_begin());
+    Accumulator result;
+    binary_tree_sum(&data, &buffer, 1, &result, plan, nullptr, &elementTransform);
+    return result;
+}
+
+template double binary_tree_transform_sum<double, double>(const double *, ReductionPlan &,
+        BinaryTreeSumWorkspace &, ElementTransform<double, double>, void *);
+template double binary_tree_transform_sum<double, float>(const float *, ReductionPlan &,
+        BinaryTreeSumWorkspace &, ElementTransform<float, double>, void *);
+template float binary_tree_transform_sum<float, float>(const float *, ReductionPlan &,
+        BinaryTreeSumWorkspace &, ElementTransform<float, float>, void *);
+
+template double binary_tree_sum<double, double>(const double *, ReductionPlan &, BinaryTreeSumWorkspace &);
+template double binary_tree_sum<double, float>(const float *, ReductionPlan &, BinaryTreeSumWorkspace &);
+template float binary_tree_sum<float, float>(const float *, ReductionPlan &, BinaryTreeSumWorkspace &);
+template double binary_tree_sum<double, double>(const double *, const size_t, MPI_Comm, const int);
+template double binary_tree_sum<double, float>(const float *, const size_t, MPI_Comm, const int);
+template float binary_tree_sum<float, float>(const float *, const size_t, MPI_Comm, const int);
+
+extern void binary_tree_sum_batch(double **data, const size_t K, double *results, ReductionPlan &plan) {
+    binary_tree_sum(data, data, K, results, plan);
+}
+
+extern MPI_Request binary_tree_sum_async(double *data, ReductionPlan &plan, double *result) {
+    MPI_Request request;
+    const double *source = data;
+    binary_tree_sum(&source, &data, 1, result, plan, &request);
+    return request;
+}
+
+extern MPI_Request binary_tree_sum_async(const double *data, ReductionPlan &plan,
+        BinaryTreeSumWorkspace &workspace, double *result) {
+    MPI_Request request;
+    double *buffer = workspace.reserve(plan.local_end() - plan.local_begin());
+    binary_tree_sum(&data, &buffer, 1, result, plan, &request);
+    return request;
+}
+
+extern MPI_Request binary_tree_sum_batch_async(double **data, const size_t K, double *results,
+        ReductionPlan &plan) {
+    MPI_Request request;
+    binary_tree_sum(data, data, K, results, plan, &request);
+    return request;
+}
+
+extern double binary_tree_sum(double *data, const size_t N, MPI_Comm comm, const int tag) {
+    ReductionPlan plan(N, comm, tag);
+    return binary_tree_sum(data, plan);
+}
+
+extern float binary_tree_sum(float *data, const size_t N, MPI_Comm comm, const int tag) {
+    ReductionPlan plan(N, comm, tag);
+    return binary_tree_sum(data, plan);
+}
+
+extern void binary_tree_sum_batch(double **data, const size_t K, const size_t N, double *results,
+        MPI_Comm comm, const int tag) {
+    ReductionPlan plan(N, comm, tag);
+    binary_tree_sum_batch(data, K, results, plan);
+}
+
+extern double binary_tree_sum(double *data, const Distribution &distribution,
+        MPI_Comm comm, const int tag) {
+    ReductionPlan plan(distribution, comm, tag);
+    return binary_tree_sum(data, plan);
+}
+
+extern double binary_tree_sum(const double *data, const Distribution &distribution,
+        MPI_Comm comm, const int tag) {
+    ReductionPlan plan(distribution, comm, tag);
+    BinaryTreeSumWorkspace workspace;
+    return binary_tree_sum(data, plan, workspace);
+}
+
+BinaryTreeSumWorkspace::BinaryTreeSumWorkspace(const size_t localElements) {
+    reserve(localElements);
+}
+
+double *BinaryTreeSumWorkspace::reserve(const size_t localElements) {
+    return reserve<double>(localElements);
+}
+
+template <typename T>
+T *BinaryTreeSumWorkspace::reserve(const size_t localElements) {
+    const size_t requiredSize = (localElements / 8 + 4) * sizeof(T);
+    if (buffer.size() < requiredSize) {
+        buffer.resize(requiredSize);
+    }
+
+    return reinterpret_cast<T *>(buffer.data());
+}
 
-        // number of remaining elements
-        const uint64_t remainder = elementsInBuffer - 8 * elementsWritten;
-        assert(0 <= remainder);
-        assert(remainder < 8);
+template float *BinaryTreeSumWorkspace::reserve<float>(const size_t localElements);
+template double *BinaryTreeSumWorkspace::reserve<double>(const size_t localElements);
 
-        if (remainder > 0) {
-            const uint64_t bufferIdx = 8 * elementsWritten;
-            const uint64_t indexOfRemainingTree = index + bufferIdx * (1UL << (y - 1));
-            const double a = sum_remaining_8tree(indexOfRemainingTree,
-                    remainder, y, maxX,
-		    &sourceBuffer[0] + bufferIdx,
-                    &destinationBuffer[0] + bufferIdx, N, p);
-            destinationBuffer[elementsWritten++] = a;
+extern double binary_tree_sum(const double *data, const size_t N, BinaryTreeSumWorkspace &workspace,
+        MPI_Comm comm, const int tag) {
+    ReductionPlan plan(N, comm, tag);
+    return binary_tree_sum(data, plan, workspace);
+}
+
+extern double binary_tree_sum(const double *data, const size_t N, MPI_Comm comm, const int tag) {
+    BinaryTreeSumWorkspace workspace;
+    return binary_tree_sum(data, N, workspace, comm, tag);
+}
+
+/**
+ * Complete subtrees of the elements of a rank, which are pushed in index
+ * order. A node (index, y) holds the sum of the elements of the subtree of
+ * height y starting at index. A node is merged with its left sibling as soon
+ * as both are complete. A complete rank-intersecting summand, whose left
+ * sibling starts before begin, is removed and handed to the caller instead.
+ * The stack holds at most one node per level, the ones waiting for a sibling.
+ *
+ * Nodes whose right sibling starts at N or later are passed through to their
+ * parent like in the tree of binary_tree_sum. With N = UNBOUNDED the stack
+ * only holds complete subtrees, the remaining ones of a growing sequence.
+ */
+struct CarryStack {
+    using Node = SubtreeSum;
+    static constexpr uint64_t UNBOUNDED = UINT64_MAX;
+
+    const uint64_t N;
+    const uint64_t begin;
+    const int height;
+    std::vector<Node> &nodes;
+
+    /**
+     * Push the complete subtree (index, y). completed(node) is called for
+     * every rank-intersecting summand that is completed by it.
+     */
+    template <typename F>
+    void push(const uint64_t index, const int y, const double value, F &&completed) {
+        nodes.push_back({index, y, value});
+
+        while (true) {
+            Node &top = nodes.back();
+            if (top.index == 0 && top.y == height) return;
+
+            if ((top.index >> top.y) & 1) {
+                // Right child, the left sibling is complete unless it starts before begin
+                if (parent_index(top.index) < begin) {
+                    completed(top);
+                    nodes.pop_back();
+                    return;
+                }
+
+                const Node right = top;
+                nodes.pop_back();
+                Node &left = nodes.back();
+                assert(left.y == right.y && left.index + (1UL << left.y) == right.index);
+                left.value = left.value + right.value;
+                left.y++;
+            } else if (N != UNBOUNDED && top.index + (1UL << top.y) >= N) {
+                // The right sibling is beyond the last element
+                top.y++;
+            } else {
+                return;
+            }
         }
+    }
 
-        elementsInBuffer = elementsWritten;
-        sourceBuffer = destinationBuffer;
+    /**
+     * Return the node (index, y) if it is on the stack, nullptr otherwise.
+     */
+    const Node *find(const uint64_t index, const int y) const {
+        for (const Node &node : nodes) {
+            if (node.index == index && node.y == y) return &node;
+        }
+        return nullptr;
     }
-        
-    assert(elementsInBuffer == 1);
+};
 
-    return destinationBuffer[0];
+/*
+ * Height of the tree of N elements.
+ */
+int tree_height(const uint64_t N) {
+    return (N <= 1) ? 0 : 64 - __builtin_clzl(N - 1);
 }
 
-extern double binary_tree_sum(double *data, const size_t N) {
+/**
+ * Sum of the complete subtree of the 2^y elements in data, y <= BLOCK_LEVELS.
+ * scratch holds at least 2^(y - 3) elements.
+ */
+double subtree_sum(const double *data, const int y, double *scratch) {
+    const auto kernel = sum_8blocks<double, double>();
+    const double *src = data;
+    uint64_t n = 1UL << y;
 
-    int rank;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    for (; n >= 8; src = scratch) {
+        n = kernel(src, scratch, n);
+    }
+    for (; n > 1; src = scratch) {
+        n /= 2;
+        for (uint64_t i = 0; i < n; i++) {
+            scratch[i] = src[2 * i] + src[2 * i + 1];
+        }
+    }
+    return src[0];
+}
 
-    int clusterSize;
-    MPI_Comm_size(MPI_COMM_WORLD, &clusterSize);
+/**
+ * Push the n elements starting at global index index onto stack, as the
+ * largest aligned subtrees of up to BLOCK_SIZE elements.
+ */
+template <typename F>
+void push_elements(CarryStack &stack, const uint64_t index, const double *data, const uint64_t n,
+        F &&completed) {
+    static thread_local std::vector<double> scratch(BLOCK_SIZE / 8);
 
-    const ldiv_t elementsPerRank = ldiv(N, clusterSize);
+    for (uint64_t offset = 0; offset < n;) {
+        const uint64_t i = index + offset;
+        const int alignment = (i == 0) ? BLOCK_LEVELS : __builtin_ctzl(i);
+        const int y = std::min({alignment, BLOCK_LEVELS, 63 - __builtin_clzl(n - offset)});
 
-    const uint64_t beginIdx = startIndex(rank, N, clusterSize);
-    const uint64_t endIdx = startIndex(rank + 1, N, clusterSize);
+        stack.push(i, y, subtree_sum(data + offset, y, scratch.data()), completed);
+        offset += 1UL << y;
+    }
+}
 
-    // Iterate over all rank-intersecting summands on ranks > 0
-    uint64_t idx;
-    for (idx = beginIdx;
-            idx != 0 && idx < endIdx;
-            idx = next_rank_intersecting_summand(idx)) {
-        double result = accumulate(idx, data + idx - beginIdx, N, clusterSize, idx, endIdx);
-        
-        if (idx != 0) {
-            MPI_Send(&result, 1, MPI_DOUBLE, rankFromIndex(parent_index(idx), N, clusterSize),
-                    0, MPI_COMM_WORLD);
+/**
+ * Read up to capacity elements from source, fewer only at its end.
+ */
+size_t read_chunk(const ElementSource &source, double *buffer, const size_t capacity) {
+    size_t elements = 0;
+    while (elements < capacity) {
+        const size_t read = source(buffer + elements, capacity - elements);
+        if (read == 0) break;
+        elements += read;
+    }
+    return elements;
+}
+
+extern double binary_tree_sum_stream(const ElementSource &source, const std::vector<SubtreeSum> &subtrees,
+        ReductionPlan &plan, const size_t chunkElements) {
+    INSTRUMENT_PHASE(totalTime);
+    INSTRUMENT_COUNT(calls, 1);
+    const uint64_t N = plan.size();
+    const uint64_t beginIdx = plan.local_begin();
+    const uint64_t endIdx = plan.local_end();
+    assert(chunkElements > 0);
+    SummandExchange<double> exchange(plan, 1);
+
+    // Send the rank-intersecting summands right away, they complete in order
+    size_t sent = 0;
+    auto send = [&](const CarryStack::Node &node) {
+        assert(exchange.outgoing_index(sent) == node.index);
+        *exchange.outgoing_values(sent) = node.value;
+        exchange.send(sent++);
+    };
+
+    std::vector<CarryStack::Node> nodes;
+    CarryStack stack {N, beginIdx, tree_height(N), nodes};
+    std::vector<double> chunks[2] = {std::vector<double>(chunkElements), std::vector<double>(chunkElements)};
+
+    // Return the global index and size of the chunk after the one ending at
+    // index, which ends at the next subtree at the latest
+    size_t skipped = 0;
+    auto next_chunk = [&](uint64_t index) {
+        while (skipped < subtrees.size() && subtrees[skipped].index == index) {
+            index = std::min(index + (1UL << subtrees[skipped++].y), N);
         }
+        const uint64_t end = (skipped < subtrees.size()) ? subtrees[skipped].index : endIdx;
+        assert(index <= end);
+        return std::pair<uint64_t, uint64_t>(index, std::min<uint64_t>(chunkElements, end - index));
+    };
+
+    // Push the given subtrees before index
+    size_t pushed = 0;
+    auto push_subtrees = [&](const uint64_t index) {
+        for (; pushed < subtrees.size() && subtrees[pushed].index < index; pushed++) {
+            const SubtreeSum &subtree = subtrees[pushed];
+
+            // Levels without elements on the right pass the partial sum through
+            int y = subtree.y;
+            while (y > 0 && subtree.index + (1UL << (y - 1)) >= N) y--;
+            stack.push(subtree.index, y, subtree.value, send);
+        }
+    };
+
+    auto read = [&](const int chunk, const uint64_t elements) {
+        return std::async(std::launch::async, read_chunk, std::cref(source), chunks[chunk].data(), elements);
+    };
+
+    auto [index, elements] = next_chunk(beginIdx);
+    std::future<size_t> nextChunk;
+    if (elements > 0) nextChunk = read(0, elements);
+
+    for (int chunk = 0; elements > 0; chunk ^= 1) {
+        [[maybe_unused]] const size_t elementsRead = nextChunk.get();
+        assert(elementsRead == elements);
+        const auto [nextIndex, nextElements] = next_chunk(index + elements);
+        if (nextElements > 0) nextChunk = read(chunk ^ 1, nextElements);
+
+        push_subtrees(index);
+        push_elements(stack, index, chunks[chunk].data(), elements, send);
+        index = nextIndex;
+        elements = nextElements;
+    }
+    push_subtrees(endIdx);
+
+    // The remaining nodes include summands of other ranks
+    auto resolve = [&](auto &resolve, const uint64_t index, const int y) -> double {
+        if (const auto *node = stack.find(index, y)) return node->value;
+
+        const uint64_t rightChild = index + (1UL << (y - 1));
+        const double left = resolve(resolve, index, y - 1);
+        if (rightChild >= N) return left;
+        if (rightChild >= endIdx) return left + *exchange.wait(rightChild);
+        return left + resolve(resolve, rightChild, y - 1);
+    };
+
+    for (; sent < exchange.outgoing_count();) {
+        const uint64_t index = exchange.outgoing_index(sent);
+        const int y = __builtin_ctzl(index);
+        send({index, y, resolve(resolve, index, y)});
     }
 
-    double result = (rank == 0) ? accumulate(0, data, N, clusterSize, idx, endIdx) : 0.0;
-    MPI_Bcast(&result, 1, MPI_DOUBLE,
-            0, MPI_COMM_WORLD);
+    double result = 0.0;
+    if (exchange.is_root()) {
+        result = resolve(resolve, 0, stack.height);
+    }
+    INSTRUMENT_PHASE(resultTime);
+    exchange.finish(&result);
+    return result;
+}
 
+extern double binary_tree_sum_stream(const ElementSource &source, ReductionPlan &plan,
+        const size_t chunkElements) {
+    return binary_tree_sum_stream(source, {}, plan, chunkElements);
+}
+
+extern double binary_tree_sum_stream(const ElementSource &source, const size_t N,
+        MPI_Comm comm, const int tag, const size_t chunkElements) {
+    ReductionPlan plan(N, comm, tag);
+    return binary_tree_sum_stream(source, plan, chunkElements);
+}
+
+ReproducibleSumTree::ReproducibleSumTree(const double *data, const size_t N,
+        MPI_Comm comm, const int tag)
+    : ReproducibleSumTree(data, Distribution(N, comm_size(comm)), comm, tag) {
+}
+
+ReproducibleSumTree::ReproducibleSumTree(const double *data, const Distribution &distribution,
+        MPI_Comm comm, const int tag)
+    : plan(distribution, comm, tag) {
+    const uint64_t N = plan.size();
+    height = tree_height(N);
+
+    // Nodes starting at local indices, level 0 are the elements themselves
+    for (int y = 0; y <= height; y++) {
+        const uint64_t size = 1UL << y;
+        const uint64_t first = (plan.local_begin() + size - 1) & ~(size - 1);
+        if (first >= plan.local_end()) break;
+
+        firstIndices.push_back(first);
+        levels.emplace_back((plan.local_end() - 1 - first) / size + 1);
+    }
+
+    if (!levels.empty()) {
+        std::copy(data, data + (plan.local_end() - plan.local_begin()), levels[0].begin());
+    }
+    for (int y = 1; y < static_cast<int>(levels.size()); y++) {
+        for (uint64_t index = firstIndices[y]; index < plan.local_end(); index += 1UL << y) {
+            if (!depends_on_other_ranks(index, y)) node(index, y) = combine(index, y);
+        }
+    }
+}
+
+double &ReproducibleSumTree::node(const uint64_t index, const int y) {
+    return levels[y][(index - firstIndices[y]) >> y];
+}
+
+bool ReproducibleSumTree::depends_on_other_ranks(const uint64_t index, const int y) const {
+    return std::min<uint64_t>(index + (1UL << y), plan.size()) > plan.local_end();
+}
+
+double ReproducibleSumTree::combine(const uint64_t index, const int y) {
+    const uint64_t rightChild = index + (1UL << (y - 1));
+    if (rightChild >= plan.size()) return node(index, y - 1);
+    return node(index, y - 1) + node(rightChild, y - 1);
+}
+
+void ReproducibleSumTree::update(const uint64_t index, const double value) {
+    update(&index, &value, 1);
+}
+
+void ReproducibleSumTree::update(const uint64_t *indices, const double *values, const size_t n) {
+    static thread_local std::vector<uint64_t> dirty;
+    dirty.assign(indices, indices + n);
+
+    for (size_t i = 0; i < n; i++) {
+        assert(indices[i] >= plan.local_begin() && indices[i] < plan.local_end());
+        node(indices[i], 0) = values[i];
+    }
+
+    // Ancestors level by level. The ones starting on lower ranks are summed
+    // there, the ones depending on higher ranks are recomputed by sum
+    for (int y = 1; y < static_cast<int>(levels.size()) && !dirty.empty(); y++) {
+        for (auto &index : dirty) {
+            index &= ~((1UL << y) - 1);
+        }
+        std::sort(dirty.begin(), dirty.end());
+        dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+        dirty.erase(std::remove_if(dirty.begin(), dirty.end(), [&](const uint64_t index) {
+                    return index < plan.local_begin() || depends_on_other_ranks(index, y);
+                }), dirty.end());
+
+        for (const uint64_t index : dirty) {
+            node(index, y) = combine(index, y);
+        }
+    }
+}
+
+double ReproducibleSumTree::get(const uint64_t index) const {
+    assert(index >= plan.local_begin() && index < plan.local_end());
+    return levels[0][index - plan.local_begin()];
+}
+
+double ReproducibleSumTree::sum() {
+    INSTRUMENT_PHASE(totalTime);
+    INSTRUMENT_COUNT(calls, 1);
+    SummandExchange<double> exchange(plan, 1);
+
+    // Recompute the nodes depending on other ranks below the given node, at
+    // most one child of such a node is local and depends on other ranks itself
+    auto refresh = [&](auto &refresh, const uint64_t index, const int y) -> double {
+        if (!depends_on_other_ranks(index, y)) return node(index, y);
+
+        const uint64_t rightChild = index + (1UL << (y - 1));
+        double value = refresh(refresh, index, y - 1);
+        if (rightChild < plan.local_end()) {
+            value += refresh(refresh, rightChild, y - 1);
+        } else if (rightChild < plan.size()) {
+            value += *exchange.wait(rightChild);
+        }
+        return node(index, y) = value;
+    };
+
+    for (size_t i = 0; i < exchange.outgoing_count(); i++) {
+        const uint64_t index = exchange.outgoing_index(i);
+        *exchange.outgoing_values(i) = refresh(refresh, index, __builtin_ctzl(index));
+        exchange.send(i);
+    }
+
+    double result = 0.0;
+    if (exchange.is_root()) {
+        result = refresh(refresh, 0, height);
+    }
+    INSTRUMENT_PHASE(resultTime);
+    exchange.finish(&result);
+    return result;
+}
+
+
+void ReproducibleAppendSum::append(const double value) {
+    pending.push_back(value);
+}
+
+void ReproducibleAppendSum::append(const double *values, const size_t n) {
+    pending.insert(pending.end(), values, values + n);
+}
+
+void ReproducibleAppendSum::flush() {
+    int rank, clusterSize;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &clusterSize);
+
+    const uint64_t count = pending.size();
+    uint64_t begin = 0;
+    uint64_t total = 0;
+    MPI_Exscan(&count, &begin, 1, MPI_UINT64_T, MPI_SUM, comm);
+    MPI_Allreduce(&count, &total, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (rank == 0) begin = 0;
+    begin += N;
+
+    // The complete subtrees of the local elements: the rank-intersecting
+    // summands, whose left siblings start on lower ranks, then the rest
+    std::vector<SubtreeSum> local;
+    CarryStack localStack {CarryStack::UNBOUNDED, begin, tree_height(CarryStack::UNBOUNDED), local};
+    std::vector<SubtreeSum> summands;
+    push_elements(localStack, begin, pending.data(), count, [&](const SubtreeSum &node) {
+        summands.push_back(node);
+    });
+    local.insert(local.begin(), summands.begin(), summands.end());
+
+    // Every rank merges the subtrees of all ranks in index order, the same
+    // additions as the tree of binary_tree_sum
+    const int localBytes = local.size() * sizeof(SubtreeSum);
+    std::vector<int> bytes(clusterSize);
+    std::vector<int> displacements(clusterSize);
+    MPI_Allgather(&localBytes, 1, MPI_INT, bytes.data(), 1, MPI_INT, comm);
+    for (int r = 1; r < clusterSize; r++) {
+        displacements[r] = displacements[r - 1] + bytes[r - 1];
+    }
+    std::vector<SubtreeSum> all((displacements.back() + bytes.back()) / sizeof(SubtreeSum));
+    MPI_Allgatherv(local.data(), localBytes, MPI_BYTE, all.data(), bytes.data(),
+            displacements.data(), MPI_BYTE, comm);
+
+    CarryStack stack {CarryStack::UNBOUNDED, 0, tree_height(CarryStack::UNBOUNDED), subtrees};
+    for (const SubtreeSum &node : all) {
+        stack.push(node.index, node.y, node.value, [](const SubtreeSum &) { assert(false); });
+    }
+
+    N += total;
+    pending.clear();
+}
+
+double ReproducibleAppendSum::sum() const {
+    // The last subtree is reached by passing through the levels above it, the
+    // others are left children of the nodes on the path to it
+    double result = subtrees.empty() ? 0.0 : subtrees.back().value;
+    for (int i = static_cast<int>(subtrees.size()) - 2; i >= 0; i--) {
+        result = subtrees[i].value + result;
+    }
     return result;
 }
@@ -3,6 +3,10 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <vector>
+#include <functional>
+#include <type_traits>
+#include <mpi.h>
 
 /**
  * Calculate the reproducible sum across all MPI ranks.
@@ -12,8 +16,664 @@
  * cluster with p processors, the first N - (N mod p) processors have 
  * floor(N / p) elements in their data array and the last N mod p processors 
  * have floor(N / p) + 1 elements in their data array.
+ *
+ * Other distributions are supported through Distribution.
+ *
+ * The reduction runs on the ranks of comm and all point-to-point messages use
+ * the given tag. Reductions on disjoint communicators can run concurrently.
+ * Reductions on the same communicator must use different tags to keep their
+ * messages apart and must be started in the same order on all ranks.
+ */
+double binary_tree_sum(double *data, const size_t N,
+        MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0);
+
+/**
+ * Same as above, but data is left untouched. The partial sums are written to
+ * a scratch buffer of about 1/8 of the local number of elements instead.
+ */
+double binary_tree_sum(const double *data, const size_t N,
+        MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0);
+
+/**
+ * Scratch memory for the non-destructive binary_tree_sum. It grows on demand
+ * to about 1/8 of the local number of elements and can be reused across calls,
+ * so repeated reductions of the same size do not allocate.
+ */
+class BinaryTreeSumWorkspace {
+public:
+    BinaryTreeSumWorkspace() = default;
+
+    /**
+     * Preallocate enough memory to reduce localElements elements.
+     */
+    explicit BinaryTreeSumWorkspace(const size_t localElements);
+
+    /**
+     * Return a buffer that is large enough to reduce localElements elements.
+     */
+    double *reserve(const size_t localElements);
+
+    /**
+     * Same as above for partial sums of type T, float or double.
+     */
+    template <typename T>
+    T *reserve(const size_t localElements);
+
+private:
+    std::vector<unsigned char> buffer;
+};
+
+/**
+ * Same as above, but the partial sums are written to workspace.
+ */
+double binary_tree_sum(const double *data, const size_t N, BinaryTreeSumWorkspace &workspace,
+        MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0);
+
+/**
+ * Calculate the reproducible sums of K arrays of N elements each across all MPI
+ * ranks in a single traversal of the tree, see binary_tree_sum. data[k] is the
+ * rank-local part of array k and is used as scratch space like above. The K
+ * sums are stored in results. Partial sums which cross ranks are sent as one
+ * message of K doubles, so the number of messages does not depend on K.
+ */
+void binary_tree_sum_batch(double **data, const size_t K, const size_t N, double *results,
+        MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0);
+
+/**
+ * Ranks which receive the result of a reduction through a ReductionPlan.
+ */
+enum class ResultMode {
+    // The result is broadcast to all ranks of the communicator
+    AllRanks,
+    // Only the root rank (ReductionPlan::root_rank()) receives the result, the
+    // other ranks return 0
+    RootOnly
+};
+
+/**
+ * Assignment of the N global elements to the p ranks of a communicator. Rank r
+ * holds the contiguous index range [begin(r), end(r)), ranks may hold no
+ * elements at all. The result of a reduction only depends on N and the data,
+ * not on the distribution.
+ */
+class Distribution {
+public:
+    /**
+     * The "even_remainder_at_end" distribution, see binary_tree_sum.
+     */
+    Distribution(const size_t N, const int p);
+
+    /**
+     * Distribution given by the prefix offsets of the ranks. offsets has p + 1
+     * entries, rank r holds [offsets[r], offsets[r + 1]). The offsets must be
+     * non-decreasing and start at 0, offsets[p] is N.
+     */
+    explicit Distribution(std::vector<uint64_t> offsets);
+
+    /**
+     * Global number of elements.
+     */
+    uint64_t size() const;
+
+    /**
+     * Number of ranks.
+     */
+    int ranks() const;
+
+    uint64_t begin(const int rank) const;
+    uint64_t end(const int rank) const;
+
+    /**
+     * Return the rank holding the given global index in O(log p).
+     */
+    int rank_of(const uint64_t index) const;
+
+private:
+    std::vector<uint64_t> offsets;
+};
+
+/**
+ * Propose a distribution of N elements to p ranks which needs few messages per
+ * reduction. Every rank boundary of "even_remainder_at_end" is moved to the
+ * index with the largest power-of-two alignment within tolerance * N / (2p)
+ * elements, so every rank holds (1 +- tolerance) * N / p elements. A rank
+ * starting at a multiple of a large power of two sends few partial sums.
+ * Boundaries never move below those of earlier ranks, nor to index 0 unless
+ * they are there already. A tolerance of 1 or more may leave ranks empty.
+ */
+Distribution aligned_distribution(const size_t N, const int p, const double tolerance);
+
+/**
+ * Return the total number of partial sums exchanged between ranks by one
+ * reduction with the given distribution.
+ */
+uint64_t message_count(const Distribution &distribution);
+
+/**
+ * Communication pattern of binary_tree_sum for a fixed N and communicator.
+ * Building the plan determines the local index range, the rank-intersecting
+ * summands sent to other ranks and the ones received from them. Reductions
+ * through a plan only do the local arithmetic and post the cached messages
+ * into buffers owned by the plan, so a plan must not be used by two
+ * reductions at the same time.
+ *
+ * The messages are persistent requests bound to these buffers. They are
+ * created by the first reduction and recreated if the number of lanes
+ * changes. The plan must be destroyed before MPI_Finalize.
+ *
+ * In hierarchical mode, summands exchanged between ranks on the same node are
+ * passed through a shared memory window instead of messages, only summands
+ * whose parent is on another node cross the network. The summation order is
+ * the same in both modes. Creating and destroying a hierarchical plan, and
+ * the first reduction with a new number of lanes, are collective over comm.
+ */
+class ReductionPlan {
+public:
+    ReductionPlan(const size_t N, MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0,
+            const ResultMode resultMode = ResultMode::AllRanks, const bool hierarchical = false);
+
+    /**
+     * Plan for elements laid out according to distribution, which must have
+     * as many ranks as comm.
+     */
+    ReductionPlan(const Distribution &distribution, MPI_Comm comm = MPI_COMM_WORLD,
+            const int tag = 0, const ResultMode resultMode = ResultMode::AllRanks,
+            const bool hierarchical = false);
+    ~ReductionPlan();
+
+    ReductionPlan(const ReductionPlan&) = delete;
+    ReductionPlan& operator=(const ReductionPlan&) = delete;
+
+    /**
+     * Global number of elements.
+     */
+    uint64_t size() const { return N; }
+
+    MPI_Comm communicator() const { return comm; }
+    int message_tag() const { return tag; }
+    ResultMode result_mode() const { return resultMode; }
+
+    /**
+     * Rank in comm that holds the first element and the result.
+     */
+    int root_rank() const { return rootRank; }
+
+    /**
+     * Global index range of the local elements.
+     */
+    uint64_t local_begin() const { return beginIdx; }
+    uint64_t local_end() const { return endIdx; }
+
+    /**
+     * Number of partial sums this rank sends to other ranks per reduction.
+     */
+    size_t outgoing_summands() const { return outgoingIndices.size(); }
+
+private:
+    // The messages of a single reduction, see binarytreesummation.cpp
+    template <typename Accumulator>
+    friend class SummandExchange;
+
+    /**
+     * Make sure the buffers and persistent requests are set up for K lanes of
+     * partial sums of the given type.
+     */
+    void prepare(const size_t K, MPI_Datatype valueType);
+
+    template <typename RankOf, typename BeginOf>
+    void find_summands(RankOf rankOf, BeginOf beginOf);
+    void find_node_ranks();
+    void free_communication();
+
+    uint64_t N;
+    MPI_Comm comm;
+    int tag;
+    ResultMode resultMode;
+    int rank;
+    int clusterSize;
+    int rootRank;
+
+    // Global index range of the local elements
+    uint64_t beginIdx;
+    uint64_t endIdx;
+
+    // Local rank-intersecting summands and the ranks of their parents
+    std::vector<uint64_t> outgoingIndices;
+    std::vector<int> outgoingRanks;
+
+    // Summands of other ranks that are consumed here, ascending by index
+    std::vector<uint64_t> incomingIndices;
+    std::vector<int> incomingRanks;
+
+    // Buffers and persistent requests reused across reductions with K lanes
+    // of valueType, K values of valueSize bytes per summand
+    size_t lanes = 0;
+    MPI_Datatype valueType = MPI_DATATYPE_NULL;
+    int valueSize = 0;
+    std::vector<unsigned char> outgoingValues;
+    std::vector<MPI_Request> outgoingRequests;
+    std::vector<unsigned char> incomingValues;
+    // Only the summands received through MPI have a request, which are all
+    // started by one MPI_Startall. incomingRequestIndices maps a summand to
+    // its request.
+    std::vector<MPI_Request> incomingRequests;
+    std::vector<size_t> incomingRequestIndices;
+
+    // Hierarchical mode: ranks of the peers in nodeComm, or -1 if they are
+    // located on another node, and the slots of the shared memory window
+    bool hierarchical;
+    MPI_Comm nodeComm = MPI_COMM_NULL;
+    MPI_Win window = MPI_WIN_NULL;
+    uint64_t sequence = 0; // number of reductions since the window was set up
+    std::vector<int> outgoingNodeRanks;
+    std::vector<int> incomingNodeRanks;
+    std::vector<size_t> incomingSlotIndices; // position in the chain of the sender
+    std::vector<char *> outgoingSlots;
+    std::vector<char *> incomingSlots;
+};
+
+/**
+ * Same as binary_tree_sum(data, N, comm, tag) with the communication pattern
+ * taken from plan.
+ */
+double binary_tree_sum(double *data, ReductionPlan &plan);
+
+/**
+ * Same as binary_tree_sum(data, N, workspace, comm, tag) with the communication
+ * pattern taken from plan.
+ */
+double binary_tree_sum(const double *data, ReductionPlan &plan, BinaryTreeSumWorkspace &workspace);
+
+/**
+ * Same as binary_tree_sum_batch(data, K, N, results, comm, tag) with the
+ * communication pattern taken from plan.
+ */
+void binary_tree_sum_batch(double **data, const size_t K, double *results, ReductionPlan &plan);
+
+/**
+ * Reproducible sum of single precision elements. The partial sums have the
+ * type Accumulator: float, or double for mixed precision, where the elements
+ * are converted while they are loaded. Supported are double -> double,
+ * float -> double and float -> float. Like above, the result does not depend
+ * on the number of ranks, but it differs between the accumulator types.
+ */
+template <typename Accumulator, typename Input>
+Accumulator binary_tree_sum(const Input *data, const size_t N,
+        MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0);
+template <typename Accumulator, typename Input>
+Accumulator binary_tree_sum(const Input *data, ReductionPlan &plan, BinaryTreeSumWorkspace &workspace);
+
+/**
+ * In-place variants for float -> float.
+ */
+float binary_tree_sum(float *data, const size_t N,
+        MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0);
+float binary_tree_sum(float *data, ReductionPlan &plan);
+
+/**
+ * Element-wise transformation for binary_tree_transform_sum, sets out[i] to
+ * f(in[i]) for the n elements of in. context is passed through unchanged.
+ * Called with chunks of the local elements, concurrently by the threads of a
+ * rank.
+ */
+template <typename Input, typename Accumulator>
+using ElementTransform = void (*)(const Input *in, Accumulator *out, const size_t n, void *context);
+
+/**
+ * Reproducible sum of f(data[i]) without materialising the transformed array.
+ * The leaves are transformed in chunks that fit into the L1 cache right before
+ * the first tree level, the summation order is the same as for binary_tree_sum
+ * of the transformed array. Element and accumulator types as above.
  */
-double binary_tree_sum(double *data, const size_t N);
+template <typename Accumulator, typename Input>
+Accumulator binary_tree_transform_sum(const Input *data, ReductionPlan &plan,
+        BinaryTreeSumWorkspace &workspace, ElementTransform<Input, Accumulator> transform,
+        void *context);
+
+/**
+ * Natural logarithm for binary_tree_transform_sum. Evaluated in double
+ * precision within about one ulp by a branch-free algorithm that is vectorised
+ * for the SIMD extensions of the CPU and gives the same results on all CPUs,
+ * unlike std::log which may differ between libm versions.
+ */
+struct LogTransform {
+    double operator()(const double x) const;
+    float operator()(const float x) const;
+};
+
+/**
+ * ElementTransform of LogTransform, vectorised.
+ */
+template <typename Input, typename Accumulator>
+void log_transform(const Input *in, Accumulator *out, const size_t n, void *context);
+
+/**
+ * Same as above for a functor f. The partial sums have the type Accumulator,
+ * which defaults to the result type of f.
+ */
+template <typename Accumulator = void, typename Input, typename F>
+auto binary_tree_transform_sum(const Input *data, ReductionPlan &plan,
+        BinaryTreeSumWorkspace &workspace, F f) {
+    using Result = std::conditional_t<std::is_void_v<Accumulator>,
+          std::invoke_result_t<F &, const Input &>, Accumulator>;
+
+    if constexpr (std::is_same_v<F, LogTransform>) {
+        return binary_tree_transform_sum<Result>(data, plan, workspace,
+                log_transform<Input, Result>, nullptr);
+    } else {
+        const ElementTransform<Input, Result> apply =
+            [](const Input *in, Result *out, const size_t n, void *context) {
+                F &function = *static_cast<F *>(context);
+                for (size_t i = 0; i < n; i++) {
+                    out[i] = function(in[i]);
+                }
+            };
+        return binary_tree_transform_sum<Result>(data, plan, workspace, apply, &f);
+    }
+}
+
+template <typename Accumulator = void, typename Input, typename F>
+auto binary_tree_transform_sum(const Input *data, const size_t N, F f,
+        MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0) {
+    ReductionPlan plan(N, comm, tag);
+    BinaryTreeSumWorkspace workspace;
+    return binary_tree_transform_sum<Accumulator>(data, plan, workspace, f);
+}
+
+namespace binary_tree_detail {
+
+/**
+ * Reduce the n partial sums in buffer, which may be src, to one. Three tree
+ * levels are reduced per pass over blocks of 8, like the SIMD kernels, the
+ * last levels and the incomplete last block one level at a time. A partial sum
+ * without right sibling is passed to the next level.
+ */
+template <size_t n, typename T>
+inline T fixed_tree_levels(const T *src, T *buffer) {
+    if constexpr (n == 1) {
+        return src[0];
+    } else if constexpr (n >= 8) {
+        constexpr size_t blocks = n / 8;
+        constexpr size_t remainder = n % 8;
+        T tail = T(0);
+        if constexpr (remainder > 0) {
+            T tailBuffer[remainder];
+            tail = fixed_tree_levels<remainder>(src + 8 * blocks, tailBuffer);
+        }
+        for (size_t j = 0; j < blocks; j++) {
+            const T *x = src + 8 * j;
+            buffer[j] = ((x[0] + x[1]) + (x[2] + x[3])) + ((x[4] + x[5]) + (x[6] + x[7]));
+        }
+        if constexpr (remainder > 0) {
+            buffer[blocks] = tail;
+        }
+        return fixed_tree_levels<(n + 7) / 8>(buffer, buffer);
+    } else {
+        for (size_t j = 0; j < n / 2; j++) {
+            buffer[j] = src[2 * j] + src[2 * j + 1];
+        }
+        if constexpr (n % 2 == 1) {
+            buffer[n / 2] = src[n - 1];
+        }
+        return fixed_tree_levels<(n + 1) / 2>(buffer, buffer);
+    }
+}
+
+} // namespace binary_tree_detail
+
+/**
+ * Reproducible sum of N elements known at compile time on a single process,
+ * bit-identical to binary_tree_sum of the same elements. All loop bounds are
+ * constants, so the tree is unrolled and no MPI functions are called. Meant
+ * for small N, the partial sums are kept on the stack.
+ */
+template <size_t N, typename T = double>
+T binary_tree_sum_fixed(const T *data) {
+    if constexpr (N == 0) {
+        return T(0);
+    } else {
+        T buffer[(N + 1) / 2];
+        return binary_tree_detail::fixed_tree_levels<N>(data, buffer);
+    }
+}
+
+/**
+ * Same as binary_tree_sum(data, N, comm, tag) for elements laid out according
+ * to distribution instead of "even_remainder_at_end". The result is the same.
+ */
+double binary_tree_sum(double *data, const Distribution &distribution,
+        MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0);
+double binary_tree_sum(const double *data, const Distribution &distribution,
+        MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0);
+
+/**
+ * Partial sum of the node at level y starting at global index index of the
+ * tree of binary_tree_sum, i.e. of its elements below index + 2^y.
+ */
+struct SubtreeSum {
+    uint64_t index;
+    int y;
+    double value;
+};
+
+/**
+ * Supplies the local elements of a rank to binary_tree_sum_stream in index
+ * order. Writes up to capacity of the next elements to buffer and returns how
+ * many were written, 0 only if no elements are left. Called from a helper
+ * thread, one call at a time.
+ */
+using ElementSource = std::function<size_t(double *buffer, const size_t capacity)>;
+
+/**
+ * Reproducible sum of elements that do not have to be resident in memory. The
+ * local elements are read from source in chunks of chunkElements, the next
+ * chunk is read while the current one is reduced. Completed power-of-two
+ * subtrees are folded into a carry stack, so memory use is
+ * O(chunkElements + log N). The result is bit-identical to binary_tree_sum.
+ */
+double binary_tree_sum_stream(const ElementSource &source, ReductionPlan &plan,
+        const size_t chunkElements = 1 << 20);
+double binary_tree_sum_stream(const ElementSource &source, const size_t N,
+        MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0, const size_t chunkElements = 1 << 20);
+
+/**
+ * Same as above where the partial sums of some subtrees of the local elements
+ * are already known, e.g. stored with the input. subtrees lists them in
+ * ascending order of index, they must not overlap and consist of local
+ * elements only. source only supplies the local elements outside of them.
+ */
+double binary_tree_sum_stream(const ElementSource &source, const std::vector<SubtreeSum> &subtrees,
+        ReductionPlan &plan, const size_t chunkElements = 1 << 20);
+
+/**
+ * Reduction tree that is kept between sums, for data of which only a few
+ * elements change between reductions. Every rank stores the partial sums of
+ * all nodes of the tree of binary_tree_sum rooted at its local indices, about
+ * twice the local number of elements. An update recomputes the O(log N)
+ * affected ancestors on the rank right away. The nodes which depend on
+ * partial sums of other ranks, at most one per level, are recomputed by sum.
+ * The result of sum is bit-identical to binary_tree_sum of the current
+ * elements.
+ */
+class ReproducibleSumTree {
+public:
+    /**
+     * Build the tree of N global elements. data holds the local elements of
+     * the "even_remainder_at_end" distribution, or of distribution.
+     */
+    ReproducibleSumTree(const double *data, const size_t N,
+            MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0);
+    ReproducibleSumTree(const double *data, const Distribution &distribution,
+            MPI_Comm comm = MPI_COMM_WORLD, const int tag = 0);
+
+    /**
+     * Set the element with the given global index, which must be local.
+     */
+    void update(const uint64_t index, const double value);
+
+    /**
+     * Set the n elements with the given global indices, which must be local.
+     * Ancestors shared by several updated elements are recomputed once.
+     */
+    void update(const uint64_t *indices, const double *values, const size_t n);
+
+    /**
+     * Return the element with the given global index, which must be local.
+     */
+    double get(const uint64_t index) const;
+
+    /**
+     * Reproducible sum of all elements on all ranks. Collective over comm.
+     */
+    double sum();
+
+private:
+    // Partial sum of the node at level y starting at global index index
+    double &node(const uint64_t index, const int y);
+
+    // The subtree of the node reaches into the elements of higher ranks
+    bool depends_on_other_ranks(const uint64_t index, const int y) const;
+
+    // Partial sum of a node from its children, which are local
+    double combine(const uint64_t index, const int y);
+
+    ReductionPlan plan;
+    int height;
+
+    // levels[y][j] is the node at level y starting at index firstIndices[y] + j * 2^y
+    std::vector<std::vector<double>> levels;
+    std::vector<uint64_t> firstIndices;
+};
+
+/**
+ * Reproducible sum of a sequence of elements that only grows. Every rank
+ * appends the elements it receives, flush places them after the elements of
+ * the previous flushes, those of lower ranks first. All ranks keep the
+ * complete power-of-two subtrees of the flushed elements, at most one per set
+ * bit of their number, so the sum is available on every rank in O(log N)
+ * without communication. The result of sum is bit-identical to
+ * binary_tree_sum of all flushed elements.
+ */
+class ReproducibleAppendSum {
+public:
+    explicit ReproducibleAppendSum(MPI_Comm comm = MPI_COMM_WORLD) : comm(comm) {}
+
+    /**
+     * Append elements on this rank. They are only part of the sum after the
+     * next flush and are kept in memory until then.
+     */
+    void append(const double value);
+    void append(const double *values, const size_t n);
+
+    /**
+     * Place the elements appended on all ranks since the last flush at the
+     * end of the sequence. Collective over comm.
+     */
+    void flush();
+
+    /**
+     * Number of flushed elements on all ranks.
+     */
+    uint64_t size() const { return N; }
+
+    /**
+     * Reproducible sum of all flushed elements, the same on all ranks.
+     */
+    double sum() const;
+
+private:
+    MPI_Comm comm;
+    uint64_t N = 0;
+    std::vector<double> pending;
+
+    // The subtrees covering the flushed elements in ascending order of index
+    std::vector<SubtreeSum> subtrees;
+};
+
+/**
+ * Non-blocking variants of the above. The local reduction and the exchange of
+ * partial sums complete before returning, the distribution of the result to
+ * the ranks selected by plan.result_mode() is returned as a request. The result
+ * is only valid after the request completed. With ResultMode::RootOnly or on
+ * a single rank the request is MPI_REQUEST_NULL. The plan may be reused right away, but the
+ * broadcasts of consecutive reductions on one communicator are collectives
+ * and must be issued in the same order on all ranks.
+ */
+MPI_Request binary_tree_sum_async(double *data, ReductionPlan &plan, double *result);
+MPI_Request binary_tree_sum_async(const double *data, ReductionPlan &plan,
+        BinaryTreeSumWorkspace &workspace, double *result);
+MPI_Request binary_tree_sum_batch_async(double **data, const size_t K, double *results,
+        ReductionPlan &plan);
+
+/**
+ * Implementations of the SIMD block reduction at the core of the local
+ * summation. All kernels produce bit-identical results.
+ */
+enum class SimdKernel {
+    // Widest kernel supported by the CPU, selected at runtime
+    Auto,
+    Scalar,
+    SSE2,
+    // Also used on AVX2 machines, AVX2 adds no floating point operations
+    AVX,
+    AVX512,
+    NEON
+};
+
+/**
+ * Select the kernel used by all following reductions. Returns false and keeps
+ * the current kernel if the CPU does not support the requested one. Must not
+ * be called concurrently with a reduction.
+ */
+bool set_simd_kernel(const SimdKernel kernel);
+
+/**
+ * Return the kernel currently in use, never SimdKernel::Auto.
+ */
+SimdKernel get_simd_kernel();
+
+/**
+ * Set the number of threads that reduce the local elements of a rank, 0 means
+ * the OpenMP default. The result does not depend on the number of threads.
+ * Without OpenMP the local reduction is single-threaded. Reductions call MPI
+ * from the calling thread only. Must not be called concurrently with a
+ * reduction.
+ */
+void set_local_threads(const int threads);
+
+/**
+ * Return the number of threads used for the local reduction.
+ */
+int get_local_threads();
+
+/**
+ * Counters and timers of the reductions started by the calling thread since
+ * its last reset_sum_statistics, so concurrent reductions on disjoint
+ * communicators are counted separately. Collected only if the library is
+ * built with BINARY_TREE_SUMMATION_STATS, otherwise all zero at no cost. Covers
+ * binary_tree_sum and its variants, binary_tree_sum_stream and
+ * ReproducibleSumTree::sum. Times are in seconds, the local reduction takes
+ * totalTime - receiveWaitTime - sendTime - resultTime.
+ */
+struct SumStatistics {
+    uint64_t calls = 0;
+    // Rank-intersecting summands, through MPI or the shared memory window
+    uint64_t messagesSent = 0;
+    uint64_t bytesSent = 0;
+    uint64_t messagesReceived = 0;
+    uint64_t bytesReceived = 0;
+
+    double totalTime = 0.0;
+    // Waiting for the summands of other ranks
+    double receiveWaitTime = 0.0;
+    // Handing the local summands to MPI or the shared memory window
+    double sendTime = 0.0;
+    // Completing the sends and distributing the result
+    double resultTime = 0.0;
+};
+
+SumStatistics get_sum_statistics();
+void reset_sum_statistics();
 
 /**
  * Calculate the start index of a given rank when distributing N numbers of p
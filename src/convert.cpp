@@ -0,0 +1,67 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <mpi.h>
+#include "io.hpp"
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+/*
+ * Convert a .psllh or .binpsllh file to the chunked format .cbpsllh or the
+ * compressed format .zbpsllh, depending on the extension of the output.
+ */
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    string input;
+    string output;
+    int block_levels = 16;
+    int ranks = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const string arg(argv[i]);
+        if (arg == "--block-levels" && i + 1 < argc) {
+            block_levels = std::atoi(argv[++i]);
+        } else if (arg == "--ranks" && i + 1 < argc) {
+            ranks = std::atoi(argv[++i]);
+        } else if (input.empty()) {
+            input = arg;
+        } else if (output.empty()) {
+            output = arg;
+        } else {
+            output.clear();
+            break;
+        }
+    }
+
+    const bool chunked = output.ends_with(".cbpsllh");
+    const bool compressed = output.ends_with(".zbpsllh");
+    if (!(chunked && block_levels >= 9 && block_levels <= 40)
+            && !(compressed && block_levels >= 0 && block_levels <= 40 && ranks > 0)) {
+        cerr << "Usage: " << argv[0] << " [--block-levels 9..40] file.binpsllh|file.psllh file.cbpsllh" << endl;
+        cerr << "       " << argv[0] << " [--block-levels 0..40] [--ranks p] file.binpsllh|file.psllh file.zbpsllh" << endl;
+        MPI_Finalize();
+        return -1;
+    }
+
+    std::vector<double> data;
+    if (input.ends_with(".psllh")) {
+        data = IO::read_psllh(input);
+    } else if (input.ends_with(".binpsllh")) {
+        data = IO::read_binpsllh(input);
+    } else {
+        cerr << "Input must end with .psllh or .binpsllh" << endl;
+        MPI_Finalize();
+        return -2;
+    }
+
+    if (chunked) {
+        IO::write_cbpsllh(output, data, block_levels);
+    } else {
+        IO::write_zbpsllh(output, data, block_levels, ranks);
+    }
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef BINARYTREE_SUMMATION_GENERATOR_H_
+#define BINARYTREE_SUMMATION_GENERATOR_H_
+
+#include <stdint.h>
+
+/**
+ * Element i of a pseudo-random global input, uniform in [0, 1). It does not
+ * depend on the distribution, so every rank generates its own slice. Other
+ * seeds give independent inputs. Shared by the benchmarks and the tests.
+ */
+inline double element(uint64_t i, const uint64_t seed = 0) {
+    // splitmix64
+    i += 0x9e3779b97f4a7c15 * (seed + 1);
+    i = (i ^ (i >> 30)) * 0xbf58476d1ce4e5b9;
+    i = (i ^ (i >> 27)) * 0x94d049bb133111eb;
+    i = i ^ (i >> 31);
+    return (i >> 11) * 0x1.0p-53;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef BINARYTREE_SUMMATION_INSTRUMENTATION_H_
+#define BINARYTREE_SUMMATION_INSTRUMENTATION_H_
+
+#include "binarytreesummation.h"
+
+#ifdef BINARY_TREE_SUMMATION_ITAC
+#include <VT.h>
+#endif
+
+/*
+ * Phases of the reductions, see SumStatistics. With
+ * BINARY_TREE_SUMMATION_STATS, INSTRUMENT_PHASE(field) adds the time until the
+ * end of the enclosing scope to the timer field of the SumStatistics of the
+ * calling thread and INSTRUMENT_COUNT(field, n) adds n to the counter field.
+ * With BINARY_TREE_SUMMATION_ITAC the scope is also an Intel Trace Analyzer
+ * region named after the field. Without either they compile to nothing.
+ */
+#if defined(BINARY_TREE_SUMMATION_STATS) || defined(BINARY_TREE_SUMMATION_ITAC)
+
+#ifdef BINARY_TREE_SUMMATION_STATS
+extern thread_local SumStatistics sumStatistics;
+#endif
+
+#ifdef BINARY_TREE_SUMMATION_ITAC
+inline int itac_region(const char *name) {
+    // Initialised once even if threads of the local reduction get here at once
+    static const int regionClass = [] {
+        int handle;
+        VT_classdef("binary_tree_sum", &handle);
+        return handle;
+    }();
+    int region;
+    VT_funcdef(name, regionClass, &region);
+    return region;
+}
+#endif
+
+class PhaseTimer {
+public:
+    PhaseTimer(double SumStatistics::*timer, [[maybe_unused]] const int region)
+        : timer(timer), region(region), start(MPI_Wtime()) {
+#ifdef BINARY_TREE_SUMMATION_ITAC
+        VT_begin(region);
+#endif
+    }
+
+    ~PhaseTimer() {
+#ifdef BINARY_TREE_SUMMATION_ITAC
+        VT_end(region);
+#endif
+#ifdef BINARY_TREE_SUMMATION_STATS
+        sumStatistics.*timer += MPI_Wtime() - start;
+#endif
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    double SumStatistics::*timer;
+    int region;
+    double start;
+};
+
+#ifdef BINARY_TREE_SUMMATION_ITAC
+#define INSTRUMENT_PHASE(field) \
+    static const int phaseRegion_##field = itac_region(#field); \
+    PhaseTimer phaseTimer_##field(&SumStatistics::field, phaseRegion_##field)
+#else
+#define INSTRUMENT_PHASE(field) PhaseTimer phaseTimer_##field(&SumStatistics::field, -1)
+#endif
+
+#else
+#define INSTRUMENT_PHASE(field) ((void) 0)
+#endif
+
+#ifdef BINARY_TREE_SUMMATION_STATS
+#define INSTRUMENT_COUNT(field, n) (sumStatistics.field += (n))
+#else
+#define INSTRUMENT_COUNT(field, n) ((void) 0)
+#endif
+
+#endif
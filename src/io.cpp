@@ -3,52 +3,940 @@
 #include <fstream>
 #include <filesystem>
 #include <cassert>
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <thread>
+#include <cstring>
+#include "binarytreesummation.h"
+#ifdef BINARY_TREE_SUMMATION_ZLIB
+#include <zlib.h>
+#endif
 
 using std::cerr;
 using std::endl;
 
-std::vector<double> IO::read_psllh(const std::string path) {
+static bool is_space(const char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static const char *skip_space(const char *begin, const char *end) {
+    while (begin < end && is_space(*begin)) begin++;
+    return begin;
+}
+
+static const char *skip_token(const char *begin, const char *end) {
+    while (begin < end && !is_space(*begin)) begin++;
+    return begin;
+}
+
+static uint64_t count_tokens(const char *begin, const char *end) {
+    uint64_t tokens = 0;
+    bool previous_space = true;
+    for (const char *c = begin; c < end; c++) {
+        const bool space = is_space(*c);
+        tokens += previous_space && !space;
+        previous_space = space;
+    }
+    return tokens;
+}
+
+/*
+ * Number of tokens starting in begin .. end - 1 of the file starting at
+ * file_begin. A token that starts before begin is not counted.
+ */
+static uint64_t count_token_starts(const char *file_begin, const char *begin, const char *end) {
+    if (begin > file_begin && !is_space(begin[-1])) begin = skip_token(begin, end);
+    return count_tokens(begin, end);
+}
+
+/*
+ * Default number of reader threads of a rank when the caller passes 0. With
+ * more than one rank these may share a node, so each rank reads on a single
+ * thread.
+ */
+static unsigned int default_threads(const int p) {
+    return (p > 1) ? 1u : std::max(1u, std::thread::hardware_concurrency());
+}
+
+/*
+ * Same as above, with the hardware threads of a node divided among the ranks
+ * of comm that run on it.
+ */
+static unsigned int default_threads(MPI_Comm comm) {
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    int node_ranks;
+    MPI_Comm_size(node_comm, &node_ranks);
+    MPI_Comm_free(&node_comm);
+    return std::max(1u, std::thread::hardware_concurrency() / node_ranks);
+}
+
+/*
+ * Map the whole file read-only, only the pages that are accessed are read.
+ */
+static const char *map_file(const std::string &path, size_t &file_size) {
     assert(std::filesystem::exists(path));
-    std::ifstream file(path);
+    const int fd = open(path.c_str(), O_RDONLY);
+    assert(fd >= 0);
+    file_size = std::filesystem::file_size(path);
+
+    void *mapping = MAP_FAILED;
+    if (file_size > 0) {
+        mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        cerr << "[ERROR] Could not map " << path << endl;
+        std::abort();
+    }
+    return static_cast<const char *>(mapping);
+}
+
+/*
+ * Number of entries of a .binpsllh file of file_size bytes whose header holds
+ * header_count. If the header does not match the size of the file a warning
+ * is printed and the number of complete entries in the file is returned.
+ */
+static uint64_t binpsllh_entries(const std::string &path, const uint64_t header_count,
+        const uint64_t file_size) {
+    const uint64_t actual = (file_size < sizeof(uint64_t)) ? 0
+        : (file_size - sizeof(uint64_t)) / sizeof(double);
+    if (header_count != actual) {
+        cerr << "[WARN] Header count did not match number of entries in " << path << endl;
+        cerr << "Header: " << header_count << endl;
+        cerr << "Actual: " << actual << endl;
+    }
+    return actual;
+}
+
+std::vector<double> IO::read_psllh(const std::string path) {
+    uint64_t num_entries;
+    return read_psllh(path, 0, 1, num_entries);
+}
 
-    unsigned int num_entries = 0;
-    file >> num_entries;
+std::vector<double> IO::read_psllh(const std::string path, const int rank,
+        const int p, uint64_t &num_entries, unsigned int threads) {
+    size_t file_size;
+    const char *file_begin = map_file(path, file_size);
+    const char *file_end = file_begin + file_size;
+    madvise(const_cast<char *>(file_begin), file_size, MADV_SEQUENTIAL);
+
+    const char *header = skip_space(file_begin, file_end);
+    num_entries = 0;
+    const auto [body, header_error] = std::from_chars(header, file_end, num_entries);
+    assert(header_error == std::errc());
     assert(num_entries > 0);
 
-    std::vector<double> result;
-    result.reserve(num_entries);
+    if (threads == 0) threads = default_threads(p);
+
+    // Split the body into one chunk per thread without cutting through a number
+    std::vector<const char *> chunk_bounds(threads + 1);
+    chunk_bounds[0] = body;
+    chunk_bounds[threads] = file_end;
+    for (unsigned int t = 1; t < threads; t++) {
+        const char *bound = body + (file_end - body) * t / threads;
+        chunk_bounds[t] = skip_token(std::max(bound, chunk_bounds[t - 1]), file_end);
+    }
+
+    // Global index of the first entry in each chunk
+    std::vector<uint64_t> chunk_offsets(threads + 1, 0);
+    {
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                chunk_offsets[t + 1] = count_tokens(chunk_bounds[t], chunk_bounds[t + 1]);
+            });
+        }
+        for (auto &worker : workers) worker.join();
+    }
+    for (unsigned int t = 0; t < threads; t++) {
+        chunk_offsets[t + 1] += chunk_offsets[t];
+    }
+
+    if (num_entries != chunk_offsets[threads]) {
+        cerr << "[WARN] Header count did not match number of entries in " << path << endl;
+        cerr << "Header: " << num_entries << endl;
+        cerr << "Actual: " << chunk_offsets[threads] << endl;
+        num_entries = chunk_offsets[threads];
+    }
+
+    const uint64_t begin = startIndex(rank, num_entries, p);
+    const uint64_t end = startIndex(rank + 1, num_entries, p);
+    std::vector<double> result(end - begin);
+
+    // Every thread parses the entries of its chunk that belong to this rank
+    {
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threads; t++) {
+            if (chunk_offsets[t + 1] <= begin || chunk_offsets[t] >= end) continue;
+
+            workers.emplace_back([&, t]() {
+                const char *c = chunk_bounds[t];
+                const char *chunk_end = chunk_bounds[t + 1];
+                uint64_t i = chunk_offsets[t];
+
+                for (; i < begin; i++) {
+                    c = skip_token(skip_space(c, chunk_end), chunk_end);
+                }
+
+                const uint64_t last = std::min(end, chunk_offsets[t + 1]);
+                for (; i < last; i++) {
+                    c = skip_space(c, chunk_end);
+                    const auto [next, error] = std::from_chars(c, chunk_end, result[i - begin]);
+                    if (error != std::errc()) {
+                        cerr << "[WARN] Could not parse entry " << i << " in " << path << endl;
+                    }
+                    c = skip_token(next, chunk_end);
+                }
+            });
+        }
+        for (auto &worker : workers) worker.join();
+    }
+
+    munmap(const_cast<char *>(file_begin), file_size);
+
+    return result;
+}
+
+std::vector<double> IO::read_psllh(const std::string path, MPI_Comm comm,
+        uint64_t &num_entries, unsigned int threads) {
+    int rank, p;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+    if (threads == 0) threads = default_threads(comm);
+
+    size_t file_size;
+    const char *file_begin = map_file(path, file_size);
+    const char *file_end = file_begin + file_size;
+
+    const char *header = skip_space(file_begin, file_end);
+    num_entries = 0;
+    const auto [body, header_error] = std::from_chars(header, file_end, num_entries);
+    assert(header_error == std::errc());
+    assert(num_entries > 0);
+
+    // This rank owns the tokens starting in its share of the bytes, the last
+    // one may extend into the share of the next rank
+    const char *range_begin = file_begin + file_size * rank / p;
+    const char *range_end = file_begin + file_size * (rank + 1) / p;
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t advice_offset = (range_begin - file_begin) / page * page;
+    madvise(const_cast<char *>(file_begin) + advice_offset,
+            range_end - file_begin - advice_offset, MADV_SEQUENTIAL);
 
-    while(!file.eof()) {
-        double num;
-        file >> num;
-        if (file) {
-            // Only insert if there were no errors
-            result.push_back(num);
+    std::vector<const char *> chunk_bounds(threads + 1);
+    for (unsigned int t = 0; t <= threads; t++) {
+        chunk_bounds[t] = range_begin + (range_end - range_begin) * t / threads;
+    }
+    std::vector<uint64_t> chunk_offsets(threads + 1, 0);
+    {
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                chunk_offsets[t + 1] = count_token_starts(file_begin, chunk_bounds[t], chunk_bounds[t + 1]);
+            });
         }
+        for (auto &worker : workers) worker.join();
+    }
+    for (unsigned int t = 0; t < threads; t++) {
+        chunk_offsets[t + 1] += chunk_offsets[t];
     }
 
-    assert(result.size() == num_entries);
-    if (num_entries != result.size()) {
+    // Global index of the first token of this rank, token 0 is the header and
+    // token i > 0 is entry i - 1
+    const uint64_t local_tokens = chunk_offsets[threads];
+    uint64_t first_token = 0;
+    uint64_t total_tokens = 0;
+    MPI_Exscan(&local_tokens, &first_token, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (rank == 0) first_token = 0;
+    MPI_Allreduce(&local_tokens, &total_tokens, 1, MPI_UINT64_T, MPI_SUM, comm);
+
+    if (rank == 0 && num_entries != total_tokens - 1) {
         cerr << "[WARN] Header count did not match number of entries in " << path << endl;
         cerr << "Header: " << num_entries << endl;
-        cerr << "Actual: " << result.size() << endl;
+        cerr << "Actual: " << total_tokens - 1 << endl;
+    }
+    // Distribute the entries that are actually there
+    num_entries = total_tokens - 1;
+
+    const uint64_t parsed_begin = std::min(std::max<uint64_t>(first_token, 1) - 1, num_entries);
+    const uint64_t parsed_end = std::min(std::max<uint64_t>(first_token + local_tokens, 1) - 1, num_entries);
+    std::vector<double> parsed(parsed_end - parsed_begin);
+    {
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                const char *c = chunk_bounds[t];
+                const char *chunk_end = chunk_bounds[t + 1];
+                if (c > file_begin && !is_space(c[-1])) c = skip_token(c, file_end);
+
+                for (uint64_t token = first_token + chunk_offsets[t];; token++) {
+                    c = skip_space(c, chunk_end);
+                    if (c >= chunk_end) break;
+                    if (token > 0 && token - 1 < num_entries) {
+                        const uint64_t i = token - 1;
+                        const auto [next, error] = std::from_chars(c, file_end, parsed[i - parsed_begin]);
+                        if (error != std::errc()) {
+                            cerr << "[WARN] Could not parse entry " << i << " in " << path << endl;
+                        }
+                    }
+                    c = skip_token(c, file_end);
+                }
+            });
+        }
+        for (auto &worker : workers) worker.join();
     }
+    munmap(const_cast<char *>(file_begin), file_size);
+
+    // Send the parsed entries to the ranks that own them under the
+    // distribution of binary_tree_sum
+    std::vector<uint64_t> parsed_ranges(2 * p);
+    const uint64_t local_range[2] = {parsed_begin, parsed_end};
+    MPI_Allgather(local_range, 2, MPI_UINT64_T, parsed_ranges.data(), 2, MPI_UINT64_T, comm);
+
+    const uint64_t begin = startIndex(rank, num_entries, p);
+    const uint64_t end = startIndex(rank + 1, num_entries, p);
+    std::vector<double> result(end - begin);
 
+    // Point-to-point messages of at most 2^30 elements, the int counts and
+    // displacements of MPI_Alltoallv overflow for slices of 2^31 elements.
+    // The duplicate keeps them apart from other messages on comm.
+    MPI_Comm exchange;
+    MPI_Comm_dup(comm, &exchange);
+    const uint64_t piece = 1UL << 30;
+    std::vector<MPI_Request> requests;
+    for (int q = 0; q < p; q++) {
+        const uint64_t recv_begin = std::max(begin, parsed_ranges[2 * q]);
+        const uint64_t recv_end = std::min(end, parsed_ranges[2 * q + 1]);
+        if (q == rank) {
+            if (recv_begin < recv_end) {
+                std::copy(parsed.begin() + (recv_begin - parsed_begin),
+                        parsed.begin() + (recv_end - parsed_begin), result.begin() + (recv_begin - begin));
+            }
+            continue;
+        }
+        for (uint64_t i = recv_begin; i < recv_end; i += piece) {
+            requests.emplace_back();
+            MPI_Irecv(result.data() + (i - begin), std::min(piece, recv_end - i), MPI_DOUBLE, q, 0,
+                    exchange, &requests.back());
+        }
+    }
+    for (int q = 0; q < p; q++) {
+        const uint64_t send_begin = std::max(parsed_begin, startIndex(q, num_entries, p));
+        const uint64_t send_end = std::min(parsed_end, startIndex(q + 1, num_entries, p));
+        if (q == rank) continue;
+        for (uint64_t i = send_begin; i < send_end; i += piece) {
+            requests.emplace_back();
+            MPI_Isend(parsed.data() + (i - parsed_begin), std::min(piece, send_end - i), MPI_DOUBLE, q, 0,
+                    exchange, &requests.back());
+        }
+    }
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+    MPI_Comm_free(&exchange);
     return result;
 }
 
 std::vector<double> IO::read_binpsllh(const std::string path) {
+    uint64_t num_entries;
+    return read_binpsllh(path, 0, 1, num_entries);
+}
+
+std::vector<double> IO::read_binpsllh(const std::string path, const int rank,
+        const int p, uint64_t &num_entries) {
     assert(std::filesystem::exists(path));
-    std::ifstream file(path);
+    std::ifstream file(path, std::ios::binary);
 
-    uint64_t num_entries = 0;
+    num_entries = 0;
     file.read(reinterpret_cast<char *>(&num_entries), sizeof(num_entries));
+    num_entries = binpsllh_entries(path, num_entries, std::filesystem::file_size(path));
+
+    const uint64_t begin = startIndex(rank, num_entries, p);
+    const uint64_t end = startIndex(rank + 1, num_entries, p);
 
     std::vector<double> result;
-    result.resize(num_entries);
+    result.resize(end - begin);
+
+    file.seekg(sizeof(num_entries) + sizeof(double) * begin);
+    file.read(reinterpret_cast<char *>(result.data()), sizeof(double) * result.size());
+    if (!file) {
+        cerr << "[ERROR] Could not read the elements of the rank from " << path << endl;
+        std::abort();
+    }
+
+    return result;
+}
+
+/*
+ * MPI_File_read_at_all of count elements of type, which must be the etype of
+ * the view of file, beyond the int range of MPI counts. All ranks make the
+ * same two collective calls, the first reads whole chunks of elements.
+ */
+static void read_at_all(MPI_File file, const MPI_Offset offset, void *buffer,
+        const uint64_t count, MPI_Datatype type) {
+    const int chunk = 1 << 20;
+    MPI_Datatype chunk_type;
+    MPI_Type_contiguous(chunk, type, &chunk_type);
+    MPI_Type_commit(&chunk_type);
+    MPI_Aint lower_bound, extent;
+    MPI_Type_get_extent(type, &lower_bound, &extent);
+
+    const uint64_t chunked = count / chunk * chunk;
+    MPI_File_read_at_all(file, offset, buffer, count / chunk, chunk_type, MPI_STATUS_IGNORE);
+    MPI_File_read_at_all(file, offset + chunked, static_cast<char *>(buffer) + extent * chunked,
+            count % chunk, type, MPI_STATUS_IGNORE);
+    MPI_Type_free(&chunk_type);
+}
+
+std::vector<double> IO::read_binpsllh_mpiio(const std::string path, MPI_Comm comm,
+        uint64_t &num_entries) {
+    int rank, p;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "romio_cb_read", "enable");
+
+    MPI_File file;
+    int error = MPI_File_open(comm, path.c_str(), MPI_MODE_RDONLY, info, &file);
+    MPI_Info_free(&info);
+    if (error != MPI_SUCCESS) {
+        cerr << "[ERROR] Could not open " << path << " with MPI-IO" << endl;
+        MPI_Abort(comm, -1);
+    }
+
+    // Only one rank reads the header to spare the metadata servers
+    num_entries = 0;
+    if (rank == 0) {
+        MPI_Offset file_size;
+        MPI_File_get_size(file, &file_size);
+        MPI_File_read_at(file, 0, &num_entries, 1, MPI_UINT64_T, MPI_STATUS_IGNORE);
+        num_entries = binpsllh_entries(path, num_entries, file_size);
+    }
+    MPI_Bcast(&num_entries, 1, MPI_UINT64_T, 0, comm);
+
+    const uint64_t begin = startIndex(rank, num_entries, p);
+    const uint64_t end = startIndex(rank + 1, num_entries, p);
+
+    std::vector<double> result;
+    result.resize(end - begin);
+
+    const MPI_Offset displacement = sizeof(num_entries) + sizeof(double) * begin;
+    MPI_File_set_view(file, displacement, MPI_DOUBLE, MPI_DOUBLE, "native", MPI_INFO_NULL);
+    read_at_all(file, 0, result.data(), result.size(), MPI_DOUBLE);
+
+    MPI_File_close(&file);
+
+    return result;
+}
+
+IO::BinpsllhMapping::BinpsllhMapping(const std::string path, const int rank, const int p) {
+    assert(std::filesystem::exists(path));
+    const int fd = open(path.c_str(), O_RDONLY);
+    assert(fd >= 0);
+
+    [[maybe_unused]] const ssize_t header_bytes = pread(fd, &global_size, sizeof(global_size), 0);
+    assert(header_bytes == sizeof(global_size));
+    global_size = binpsllh_entries(path, global_size, std::filesystem::file_size(path));
+
+    const uint64_t begin = startIndex(rank, global_size, p);
+    const uint64_t end = startIndex(rank + 1, global_size, p);
+    local_size = end - begin;
+
+    if (local_size > 0) {
+        // mmap offsets must be page aligned, map from the page containing begin
+        const size_t page_size = sysconf(_SC_PAGESIZE);
+        const size_t offset = sizeof(global_size) + sizeof(double) * begin;
+        const size_t aligned_offset = offset - (offset % page_size);
+        mapping_length = offset + sizeof(double) * local_size - aligned_offset;
+
+        mapping = mmap(nullptr, mapping_length, PROT_READ, MAP_PRIVATE | MAP_POPULATE,
+                fd, aligned_offset);
+        if (mapping == MAP_FAILED) {
+            cerr << "[ERROR] Could not map " << path << endl;
+            std::abort();
+        }
+        madvise(mapping, mapping_length, MADV_SEQUENTIAL);
+        madvise(mapping, mapping_length, MADV_WILLNEED);
+
+        local_data = reinterpret_cast<const double *>(
+                static_cast<const char *>(mapping) + (offset - aligned_offset));
+    }
+
+    close(fd);
+}
+
+IO::BinpsllhMapping::~BinpsllhMapping() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_length);
+    }
+}
+
+IO::BinpsllhStream::BinpsllhStream(const std::string path, const int rank, const int p) {
+    assert(std::filesystem::exists(path));
+    fd = open(path.c_str(), O_RDONLY);
+    assert(fd >= 0);
+
+    [[maybe_unused]] const ssize_t header_bytes = pread(fd, &global_size, sizeof(global_size), 0);
+    assert(header_bytes == sizeof(global_size));
+    global_size = binpsllh_entries(path, global_size, std::filesystem::file_size(path));
+
+    const uint64_t begin = startIndex(rank, global_size, p);
+    const uint64_t end = startIndex(rank + 1, global_size, p);
+    local_size = end - begin;
+    offset = sizeof(global_size) + sizeof(double) * begin;
+
+    posix_fadvise(fd, offset, sizeof(double) * local_size, POSIX_FADV_SEQUENTIAL);
+}
+
+IO::BinpsllhStream::~BinpsllhStream() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+size_t IO::BinpsllhStream::read(double *buffer, const size_t capacity) {
+    const size_t elements = std::min(capacity, local_size - position);
+    char *bytes = reinterpret_cast<char *>(buffer);
+    size_t bytes_read = 0;
+
+    while (bytes_read < sizeof(double) * elements) {
+        const ssize_t result = pread(fd, bytes + bytes_read, sizeof(double) * elements - bytes_read,
+                offset + sizeof(double) * position + bytes_read);
+        if (result <= 0) {
+            cerr << "[ERROR] Could not read the elements of the rank from the file" << endl;
+            std::abort();
+        }
+        bytes_read += result;
+    }
+
+    position += elements;
+    return elements;
+}
+
+/*
+ * On-disk layout of .cbpsllh files, see io.hpp.
+ */
+static const char CBPSLLH_MAGIC[8] = "CBPSLLH";
+static const uint32_t CBPSLLH_VERSION = 1;
+static const uint64_t CBPSLLH_DATA_OFFSET = 4096;
+
+struct CbpsllhHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_levels;
+    uint64_t num_entries;
+    uint64_t num_blocks;
+    uint64_t data_offset;
+    uint64_t index_offset;
+    uint64_t reserved[2];
+};
+static_assert(sizeof(CbpsllhHeader) == 64);
+
+struct CbpsllhBlock {
+    double sum;
+    uint64_t checksum;
+};
+static_assert(sizeof(CbpsllhBlock) == 16);
+
+static uint64_t block_checksum(const double *data, const size_t n) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t word;
+        std::memcpy(&word, &data[i], sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3;
+    }
+    return hash;
+}
+
+static void pread_all(const int fd, void *buffer, const size_t bytes, const size_t offset) {
+    char *destination = static_cast<char *>(buffer);
+    size_t bytes_read = 0;
+    while (bytes_read < bytes) {
+        const ssize_t result = pread(fd, destination + bytes_read, bytes - bytes_read, offset + bytes_read);
+        if (result <= 0) {
+            cerr << "[ERROR] Unexpected end of file" << endl;
+            std::abort();
+        }
+        bytes_read += result;
+    }
+}
+
+void IO::write_cbpsllh(const std::string path, const std::vector<double> &data,
+        const int block_levels) {
+    assert(9 <= block_levels && block_levels <= 40);
+    const uint64_t block_size = 1UL << block_levels;
+    const uint64_t num_blocks = (data.size() + block_size - 1) / block_size;
+
+    CbpsllhHeader header {};
+    std::memcpy(header.magic, CBPSLLH_MAGIC, sizeof(header.magic));
+    header.version = CBPSLLH_VERSION;
+    header.block_levels = block_levels;
+    header.num_entries = data.size();
+    header.num_blocks = num_blocks;
+    header.data_offset = CBPSLLH_DATA_OFFSET;
+    header.index_offset = CBPSLLH_DATA_OFFSET + sizeof(double) * data.size();
+
+    // The block is the subtree of the elements of the block alone
+    std::vector<CbpsllhBlock> index(num_blocks);
+    for (uint64_t b = 0; b < num_blocks; b++) {
+        const double *block = data.data() + b * block_size;
+        const uint64_t n = std::min<uint64_t>(block_size, data.size() - b * block_size);
+        index[b].sum = binary_tree_sum(block, n, MPI_COMM_SELF);
+        index[b].checksum = block_checksum(block, n);
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    const std::vector<char> padding(CBPSLLH_DATA_OFFSET - sizeof(header), 0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(padding.data(), padding.size());
+    file.write(reinterpret_cast<const char *>(data.data()), sizeof(double) * data.size());
+    file.write(reinterpret_cast<const char *>(index.data()), sizeof(CbpsllhBlock) * index.size());
+    if (!file) {
+        cerr << "[ERROR] Could not write " << path << endl;
+        std::abort();
+    }
+}
+
+IO::CbpsllhFile::CbpsllhFile(const std::string path, const int rank, const int p,
+        const bool use_block_sums) {
+    assert(std::filesystem::exists(path));
+    fd = open(path.c_str(), O_RDONLY);
+    assert(fd >= 0);
+
+    CbpsllhHeader header;
+    pread_all(fd, &header, sizeof(header), 0);
+    if (std::memcmp(header.magic, CBPSLLH_MAGIC, sizeof(header.magic)) != 0
+            || header.version != CBPSLLH_VERSION) {
+        cerr << "[ERROR] " << path << " is not a .cbpsllh file of version " << CBPSLLH_VERSION << endl;
+        std::abort();
+    }
+
+    levels = header.block_levels;
+    data_offset = header.data_offset;
+    global_size = header.num_entries;
+    begin = startIndex(rank, global_size, p);
+    end = startIndex(rank + 1, global_size, p);
+    position = begin;
+
+    // One read of the index entries of the slice
+    const uint64_t block_size = 1UL << levels;
+    if (end > begin) {
+        first_block = begin / block_size;
+        const uint64_t blocks = (end - 1) / block_size + 1 - first_block;
+        std::vector<CbpsllhBlock> index(blocks);
+        pread_all(fd, index.data(), sizeof(CbpsllhBlock) * blocks,
+                header.index_offset + sizeof(CbpsllhBlock) * first_block);
+
+        for (uint64_t b = 0; b < blocks; b++) {
+            const uint64_t block_begin = (first_block + b) * block_size;
+            const uint64_t block_end = std::min(block_begin + block_size, global_size);
+            checksums.push_back(index[b].checksum);
+            if (use_block_sums && begin <= block_begin && block_end <= end) {
+                skipped_blocks.push_back({block_begin, levels, index[b].sum});
+            }
+        }
+    }
+
+    posix_fadvise(fd, data_offset + sizeof(double) * begin, sizeof(double) * size(),
+            POSIX_FADV_SEQUENTIAL);
+}
+
+IO::CbpsllhFile::~CbpsllhFile() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+size_t IO::CbpsllhFile::read(double *buffer, const size_t capacity) {
+    const uint64_t block_size = 1UL << levels;
+    while (next_skipped < skipped_blocks.size() && skipped_blocks[next_skipped].index == position) {
+        position = std::min(position + block_size, global_size);
+        next_skipped++;
+    }
+
+    const uint64_t read_end = (next_skipped < skipped_blocks.size())
+        ? skipped_blocks[next_skipped].index : end;
+    const size_t elements = std::min<uint64_t>(capacity, read_end - position);
+    pread_all(fd, buffer, sizeof(double) * elements, data_offset + sizeof(double) * position);
+    position += elements;
+    return elements;
+}
+
+bool IO::CbpsllhFile::verify() const {
+    const uint64_t block_size = 1UL << levels;
+    std::vector<double> block;
+    for (size_t b = 0; b < checksums.size(); b++) {
+        const uint64_t block_begin = (first_block + b) * block_size;
+        const uint64_t n = std::min(block_size, global_size - block_begin);
+        block.resize(n);
+        pread_all(fd, block.data(), sizeof(double) * n, data_offset + sizeof(double) * block_begin);
+        if (block_checksum(block.data(), n) != checksums[b]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * On-disk layout of .zbpsllh files, see io.hpp.
+ */
+static const char ZBPSLLH_MAGIC[8] = "ZBPSLLH";
+static const uint32_t ZBPSLLH_VERSION = 1;
+static const uint32_t ZBPSLLH_SHUFFLE = 0;
+static const uint32_t ZBPSLLH_ZLIB = 1;
+
+struct ZbpsllhHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t codec;
+    uint64_t num_entries;
+    uint64_t num_blocks;
+    uint64_t reserved[4];
+};
+static_assert(sizeof(ZbpsllhHeader) == 64);
+
+struct ZbpsllhBlock {
+    uint64_t first_element;
+    uint64_t offset;
+};
+
+void IO::write_zbpsllh(const std::string path, const std::vector<double> &data,
+        const int block_levels, const int ranks, const bool compress) {
+    assert(0 <= block_levels && block_levels <= 40 && ranks > 0);
+    const uint64_t N = data.size();
+
+    // Block boundaries at multiples of the block size and at rank boundaries
+    std::vector<uint64_t> bounds;
+    for (uint64_t i = 0; i < N; i += 1UL << block_levels) bounds.push_back(i);
+    for (int r = 1; r < ranks; r++) bounds.push_back(startIndex(r, N, ranks));
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    bounds.erase(std::remove(bounds.begin(), bounds.end(), N), bounds.end());
+
+    ZbpsllhHeader header {};
+    std::memcpy(header.magic, ZBPSLLH_MAGIC, sizeof(header.magic));
+    header.version = ZBPSLLH_VERSION;
+#ifdef BINARY_TREE_SUMMATION_ZLIB
+    header.codec = compress ? ZBPSLLH_ZLIB : ZBPSLLH_SHUFFLE;
+#else
+    header.codec = ZBPSLLH_SHUFFLE;
+#endif
+    header.num_entries = N;
+    header.num_blocks = bounds.size();
+
+    std::vector<ZbpsllhBlock> index(bounds.size() + 1);
+    uint64_t offset = sizeof(header) + sizeof(ZbpsllhBlock) * index.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.seekp(offset);
+
+    std::vector<unsigned char> shuffled;
+    std::vector<unsigned char> compressed;
+    for (size_t b = 0; b < bounds.size(); b++) {
+        const uint64_t first = bounds[b];
+        const uint64_t n = ((b + 1 < bounds.size()) ? bounds[b + 1] : N) - first;
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data.data() + first);
+
+        shuffled.resize(sizeof(double) * n);
+        for (uint64_t i = 0; i < n; i++) {
+            for (size_t j = 0; j < sizeof(double); j++) {
+                shuffled[j * n + i] = bytes[i * sizeof(double) + j];
+            }
+        }
+
+        const unsigned char *block = shuffled.data();
+        size_t block_bytes = shuffled.size();
+#ifdef BINARY_TREE_SUMMATION_ZLIB
+        uLongf compressed_bytes = compressBound(shuffled.size());
+        compressed.resize(compressed_bytes);
+        if (header.codec == ZBPSLLH_ZLIB && compress2(compressed.data(), &compressed_bytes, shuffled.data(), shuffled.size(),
+                    Z_DEFAULT_COMPRESSION) == Z_OK && compressed_bytes < shuffled.size()) {
+            block = compressed.data();
+            block_bytes = compressed_bytes;
+        }
+#endif
+
+        index[b] = {first, offset};
+        file.write(reinterpret_cast<const char *>(block), block_bytes);
+        offset += block_bytes;
+    }
+    index.back() = {N, offset};
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(index.data()), sizeof(ZbpsllhBlock) * index.size());
+    if (!file) {
+        cerr << "[ERROR] Could not write " << path << endl;
+        std::abort();
+    }
+}
+
+/*
+ * Header and index of a .zbpsllh file.
+ */
+struct ZbpsllhIndex {
+    ZbpsllhHeader header;
+    std::vector<ZbpsllhBlock> blocks;
+
+    // Blocks first .. last - 1 overlap the elements begin .. end - 1
+    std::pair<size_t, size_t> overlapping(const uint64_t begin, const uint64_t end) const {
+        if (begin == end) return {0, 0};
+
+        // The last entry only marks the end
+        const auto elements_end = blocks.end() - 1;
+        const size_t first = std::partition_point(blocks.begin(), elements_end,
+                [&](const ZbpsllhBlock &block) { return block.first_element <= begin; }) - blocks.begin() - 1;
+        const size_t last = std::partition_point(blocks.begin(), elements_end,
+                [&](const ZbpsllhBlock &block) { return block.first_element < end; }) - blocks.begin();
+        return {first, last};
+    }
+};
+
+static void check_zbpsllh_header(const ZbpsllhHeader &header, const std::string &path) {
+    if (std::memcmp(header.magic, ZBPSLLH_MAGIC, sizeof(header.magic)) != 0
+            || header.version != ZBPSLLH_VERSION) {
+        cerr << "[ERROR] " << path << " is not a .zbpsllh file of version " << ZBPSLLH_VERSION << endl;
+        std::abort();
+    }
+#ifndef BINARY_TREE_SUMMATION_ZLIB
+    if (header.codec == ZBPSLLH_ZLIB) {
+        cerr << "[ERROR] " << path << " is compressed with zlib, which is not available" << endl;
+        std::abort();
+    }
+#endif
+}
+
+/*
+ * Decompress the blocks first .. last - 1 stored in bytes, which starts at the
+ * file offset of block first, and write their elements begin .. end - 1 to
+ * result. The blocks are distributed over the threads.
+ */
+static void decompress_zbpsllh(const ZbpsllhIndex &index, const size_t first, const size_t last,
+        const unsigned char *bytes, const uint64_t begin, const uint64_t end, double *result,
+        unsigned int threads) {
+    assert(threads > 0);
+    threads = std::min<size_t>(threads, last - first);
+
+    auto decompress = [&](const unsigned int t) {
+        std::vector<unsigned char> shuffled;
+        for (size_t b = first + t; b < last; b += threads) {
+            const uint64_t block_begin = index.blocks[b].first_element;
+            const uint64_t n = index.blocks[b + 1].first_element - block_begin;
+            const unsigned char *block = bytes + (index.blocks[b].offset - index.blocks[first].offset);
+            const size_t block_bytes = index.blocks[b + 1].offset - index.blocks[b].offset;
+
+            shuffled.resize(sizeof(double) * n);
+            if (block_bytes == shuffled.size()) {
+                std::memcpy(shuffled.data(), block, block_bytes);
+            } else {
+#ifdef BINARY_TREE_SUMMATION_ZLIB
+                uLongf shuffled_bytes = shuffled.size();
+                if (uncompress(shuffled.data(), &shuffled_bytes, block, block_bytes) != Z_OK
+                        || shuffled_bytes != shuffled.size()) {
+                    cerr << "[ERROR] Could not decompress block " << b << endl;
+                    std::abort();
+                }
+#endif
+            }
+
+            const uint64_t local_begin = std::max(begin, block_begin) - block_begin;
+            const uint64_t local_end = std::min(end, block_begin + n) - block_begin;
+            for (uint64_t i = local_begin; i < local_end; i++) {
+                unsigned char element[sizeof(double)];
+                for (size_t j = 0; j < sizeof(double); j++) {
+                    element[j] = shuffled[j * n + i];
+                }
+                std::memcpy(&result[block_begin + i - begin], element, sizeof(double));
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.emplace_back(decompress, t);
+    }
+    for (auto &worker : workers) worker.join();
+}
+
+std::vector<double> IO::read_zbpsllh(const std::string path, const int rank,
+        const int p, uint64_t &num_entries, unsigned int threads) {
+    assert(std::filesystem::exists(path));
+    const int fd = open(path.c_str(), O_RDONLY);
+    assert(fd >= 0);
+
+    ZbpsllhIndex index;
+    pread_all(fd, &index.header, sizeof(index.header), 0);
+    check_zbpsllh_header(index.header, path);
+    index.blocks.resize(index.header.num_blocks + 1);
+    pread_all(fd, index.blocks.data(), sizeof(ZbpsllhBlock) * index.blocks.size(), sizeof(index.header));
+
+    num_entries = index.header.num_entries;
+    const uint64_t begin = startIndex(rank, num_entries, p);
+    const uint64_t end = startIndex(rank + 1, num_entries, p);
+    const auto [first, last] = index.overlapping(begin, end);
+
+    // One read of the compressed blocks of the slice
+    std::vector<unsigned char> bytes(index.blocks[last].offset - index.blocks[first].offset);
+    pread_all(fd, bytes.data(), bytes.size(), index.blocks[first].offset);
+    close(fd);
+
+    std::vector<double> result(end - begin);
+    if (threads == 0) threads = default_threads(p);
+    decompress_zbpsllh(index, first, last, bytes.data(), begin, end, result.data(), threads);
+    return result;
+}
+
+std::vector<double> IO::read_zbpsllh_mpiio(const std::string path, MPI_Comm comm,
+        uint64_t &num_entries, unsigned int threads) {
+    int rank, p;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "romio_cb_read", "enable");
+
+    MPI_File file;
+    int error = MPI_File_open(comm, path.c_str(), MPI_MODE_RDONLY, info, &file);
+    MPI_Info_free(&info);
+    if (error != MPI_SUCCESS) {
+        cerr << "[ERROR] Could not open " << path << " with MPI-IO" << endl;
+        MPI_Abort(comm, -1);
+    }
+
+    // Only one rank reads the header and the index to spare the metadata servers
+    ZbpsllhIndex index;
+    if (rank == 0) {
+        MPI_File_read_at(file, 0, &index.header, sizeof(index.header), MPI_BYTE, MPI_STATUS_IGNORE);
+        check_zbpsllh_header(index.header, path);
+    }
+    MPI_Bcast(&index.header, sizeof(index.header), MPI_BYTE, 0, comm);
+    index.blocks.resize(index.header.num_blocks + 1);
+    const size_t index_bytes = sizeof(ZbpsllhBlock) * index.blocks.size();
+    assert(index_bytes <= INT_MAX);
+    if (rank == 0) {
+        MPI_File_read_at(file, sizeof(index.header), index.blocks.data(), index_bytes, MPI_BYTE,
+                MPI_STATUS_IGNORE);
+    }
+    MPI_Bcast(index.blocks.data(), index_bytes, MPI_BYTE, 0, comm);
+
+    num_entries = index.header.num_entries;
+    const uint64_t begin = startIndex(rank, num_entries, p);
+    const uint64_t end = startIndex(rank + 1, num_entries, p);
+    const auto [first, last] = index.overlapping(begin, end);
 
-    file.read(reinterpret_cast<char *>(&result[0]), sizeof(double) * (num_entries));
-    assert(result.size() == num_entries);
+    std::vector<unsigned char> bytes(index.blocks[last].offset - index.blocks[first].offset);
+    read_at_all(file, index.blocks[first].offset, bytes.data(), bytes.size(), MPI_BYTE);
+    MPI_File_close(&file);
 
+    std::vector<double> result(end - begin);
+    if (threads == 0) threads = default_threads(comm);
+    decompress_zbpsllh(index, first, last, bytes.data(), begin, end, result.data(), threads);
     return result;
 }
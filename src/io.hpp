@@ -1,8 +1,242 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <mpi.h>
+#include "binarytreesummation.h"
 
 namespace IO {
     std::vector<double> read_psllh(const std::string path);
+
+    /**
+     * Parse only the entries of a .psllh file that belong to the given rank,
+     * i.e. the range startIndex(rank) .. startIndex(rank + 1). The file is
+     * mapped and split into chunks at whitespace boundaries which are parsed
+     * by the given number of threads (0 means one per hardware thread on a
+     * single rank and one thread otherwise).
+     *
+     * Without communication the offset of the slice is only known after
+     * counting the entries before it, so every rank reads the whole file and
+     * the total I/O is p times the file. Use the collective variant below
+     * when all ranks read.
+     *
+     * The global number of entries is stored in num_entries. If it differs
+     * from the header count a warning is printed and the entries found in the
+     * file are distributed, the result is never padded.
+     */
+    std::vector<double> read_psllh(const std::string path, const int rank,
+            const int p, uint64_t &num_entries, unsigned int threads = 0);
+
+    /**
+     * Same as above for all ranks of comm, which read about 1/p of the file
+     * each. Every rank parses the entries starting in its share of the bytes,
+     * the offsets of the shares are combined by MPI_Exscan and the entries are
+     * sent to the ranks owning them. 0 threads means the hardware threads of
+     * a node divided among its ranks. Must be called by all ranks of comm.
+     */
+    std::vector<double> read_psllh(const std::string path, MPI_Comm comm,
+            uint64_t &num_entries, unsigned int threads = 0);
     std::vector<double> read_binpsllh(const std::string path);
+
+    /**
+     * Read only the elements of a .binpsllh file that belong to the given rank
+     * under the distribution used by binary_tree_sum, i.e. the range
+     * startIndex(rank) .. startIndex(rank + 1).
+     *
+     * The global number of entries is stored in num_entries. If it differs
+     * from the header count a warning is printed and the entries found in the
+     * file are distributed, the result is never padded.
+     */
+    std::vector<double> read_binpsllh(const std::string path, const int rank,
+            const int p, uint64_t &num_entries);
+
+    /**
+     * Same as the rank-local read_binpsllh, but all ranks of comm read their
+     * slice collectively through MPI-IO so the MPI library can aggregate the
+     * accesses. Must be called by all ranks of comm.
+     */
+    std::vector<double> read_binpsllh_mpiio(const std::string path, MPI_Comm comm,
+            uint64_t &num_entries);
+
+    /**
+     * Read-only memory mapping of the rank-local slice of a .binpsllh file,
+     * see read_binpsllh(path, rank, p, num_entries). The pages are populated
+     * on construction and unmapped on destruction.
+     */
+    class BinpsllhMapping {
+    public:
+        BinpsllhMapping(const std::string path, const int rank, const int p);
+        ~BinpsllhMapping();
+
+        BinpsllhMapping(const BinpsllhMapping&) = delete;
+        BinpsllhMapping& operator=(const BinpsllhMapping&) = delete;
+
+        const double *data() const { return local_data; }
+        size_t size() const { return local_size; }
+        uint64_t num_entries() const { return global_size; }
+
+    private:
+        void  *mapping = nullptr;
+        size_t mapping_length = 0;
+        const double *local_data = nullptr;
+        size_t local_size = 0;
+        uint64_t global_size = 0;
+    };
+
+    /**
+     * Sequential reader of the rank-local slice of a .binpsllh file, see
+     * read_binpsllh(path, rank, p, num_entries). Only the elements requested by
+     * read are held in memory, so it can be used as the ElementSource of
+     * binary_tree_sum_stream for files larger than the memory of a rank.
+     */
+    class BinpsllhStream {
+    public:
+        BinpsllhStream(const std::string path, const int rank, const int p);
+        ~BinpsllhStream();
+
+        BinpsllhStream(const BinpsllhStream&) = delete;
+        BinpsllhStream& operator=(const BinpsllhStream&) = delete;
+
+        /**
+         * Read up to capacity of the next elements into buffer and return
+         * how many were read, 0 at the end of the slice.
+         */
+        size_t read(double *buffer, const size_t capacity);
+
+        size_t size() const { return local_size; }
+        uint64_t num_entries() const { return global_size; }
+
+    private:
+        int fd = -1;
+        size_t offset = 0;
+        size_t local_size = 0;
+        size_t position = 0;
+        uint64_t global_size = 0;
+    };
+
+    /*
+     * Chunked binary format .cbpsllh, version 1. A header of 64 bytes
+     *
+     *   char     magic[8]      "CBPSLLH"
+     *   uint32_t version       1
+     *   uint32_t block_levels  blocks hold 2^block_levels elements
+     *   uint64_t num_entries
+     *   uint64_t num_blocks
+     *   uint64_t data_offset   4096
+     *   uint64_t index_offset
+     *   uint64_t reserved[2]
+     *
+     * is followed by the elements from data_offset on, so every block starts
+     * at a page-aligned file offset, and by an index of num_blocks entries of
+     *
+     *   double   sum           partial sum of the block in the tree of binary_tree_sum
+     *   uint64_t checksum      FNV-1a of the 64 bit words of the block
+     *
+     * at index_offset. Only the last block may be incomplete.
+     */
+
+    /**
+     * Write data to a .cbpsllh file with blocks of 2^block_levels elements,
+     * 9 <= block_levels <= 40.
+     */
+    void write_cbpsllh(const std::string path, const std::vector<double> &data,
+            const int block_levels = 16);
+
+    /*
+     * Compressed binary format .zbpsllh, version 1. A header of 64 bytes
+     *
+     *   char     magic[8]      "ZBPSLLH"
+     *   uint32_t version       1
+     *   uint32_t codec         0: byte shuffle only, 1: byte shuffle and zlib
+     *   uint64_t num_entries
+     *   uint64_t num_blocks
+     *   uint64_t reserved[4]
+     *
+     * is followed by an index of num_blocks + 1 entries of
+     *
+     *   uint64_t first_element global index of the first element of the block
+     *   uint64_t offset        file offset of the compressed block
+     *
+     * the last of which marks the end of the elements and of the file. The
+     * blocks can be decompressed independently. Their bytes are shuffled, all
+     * first bytes of the elements first, then all second bytes and so on.
+     * Blocks of the same size as the shuffled elements are not compressed.
+     */
+
+    /**
+     * Write data to a .zbpsllh file. Blocks end at multiples of
+     * 2^block_levels elements and at the rank boundaries of the distribution
+     * of binary_tree_sum over ranks ranks, so these ranks only decompress
+     * their own elements. Other rank counts read at most two blocks more.
+     * The blocks are compressed with zlib if compress and zlib is available,
+     * otherwise they are only shuffled.
+     */
+    void write_zbpsllh(const std::string path, const std::vector<double> &data,
+            const int block_levels = 16, const int ranks = 1, const bool compress = true);
+
+    /**
+     * Same as read_binpsllh(path, rank, p, num_entries) for .zbpsllh files.
+     * Reads and decompresses only the blocks overlapping the slice, on the
+     * given number of threads (0 means one per hardware thread on a single
+     * rank and one thread otherwise).
+     */
+    std::vector<double> read_zbpsllh(const std::string path, const int rank,
+            const int p, uint64_t &num_entries, unsigned int threads = 0);
+
+    /**
+     * Same as read_binpsllh_mpiio for .zbpsllh files, the compressed blocks
+     * of all ranks are read collectively. 0 threads means the hardware threads
+     * of a node divided among its ranks. Must be called by all ranks of comm.
+     */
+    std::vector<double> read_zbpsllh_mpiio(const std::string path, MPI_Comm comm,
+            uint64_t &num_entries, unsigned int threads = 0);
+
+    /**
+     * Reader of the rank-local slice of a .cbpsllh file, see
+     * read_binpsllh(path, rank, p, num_entries). If use_block_sums, the
+     * blocks that lie within the slice are not read: block_sums lists their
+     * stored partial sums for binary_tree_sum_stream and read skips them.
+     */
+    class CbpsllhFile {
+    public:
+        CbpsllhFile(const std::string path, const int rank, const int p,
+                const bool use_block_sums = false);
+        ~CbpsllhFile();
+
+        CbpsllhFile(const CbpsllhFile&) = delete;
+        CbpsllhFile& operator=(const CbpsllhFile&) = delete;
+
+        /**
+         * Read up to capacity of the next elements into buffer and return
+         * how many were read, 0 at the end of the slice.
+         */
+        size_t read(double *buffer, const size_t capacity);
+
+        /**
+         * Compare the checksums of all blocks overlapping the slice with the
+         * index. Reads these blocks completely.
+         */
+        bool verify() const;
+
+        const std::vector<SubtreeSum> &block_sums() const { return skipped_blocks; }
+        size_t size() const { return end - begin; }
+        uint64_t num_entries() const { return global_size; }
+        int block_levels() const { return levels; }
+
+    private:
+        int fd = -1;
+        int levels = 0;
+        uint64_t data_offset = 0;
+        uint64_t global_size = 0;
+        uint64_t begin = 0;
+        uint64_t end = 0;
+        uint64_t position = 0;
+
+        // Checksums of the blocks overlapping the slice, from first_block on
+        uint64_t first_block = 0;
+        std::vector<uint64_t> checksums;
+
+        std::vector<SubtreeSum> skipped_blocks;
+        size_t next_skipped = 0;
+    };
 }
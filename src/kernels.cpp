@@ -0,0 +1,545 @@
+#include <cstdint>
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BINARYTREE_SUMMATION_X86
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+
+template <typename Input, typename Accumulator>
+uint64_t sum_8blocks_scalar(const Input *src, Accumulator *dst, const uint64_t n) {
+    uint64_t elementsWritten = 0;
+
+    for (uint64_t i = 0; i + 8 <= n; i += 8) {
+        Accumulator x[8];
+        std::copy(&src[i], &src[i + 8], x);
+
+        const Accumulator level2A = (x[0] + x[1]) + (x[2] + x[3]);
+        const Accumulator level2B = (x[4] + x[5]) + (x[6] + x[7]);
+        dst[elementsWritten++] = level2A + level2B;
+    }
+
+    return elementsWritten;
+}
+
+#ifdef BINARYTREE_SUMMATION_X86
+/*
+ * The vector kernels below never add horizontally. Even and odd elements are
+ * separated with shuffles, so every tree level is a vertical addition and
+ * several blocks are reduced side by side until a whole vector of level 3
+ * sums can be stored. The remaining blocks are handled by narrower loops.
+ *
+ * The kernels accumulating in double are templates on the input type, float
+ * elements are converted to double while loading. The loads are exact, so the
+ * result is the same as for an array of doubles with the same values.
+ */
+
+__attribute__((target("sse2"), always_inline))
+inline __m128d load_sse2(const double *x) {
+    return _mm_loadu_pd(x);
+}
+
+__attribute__((target("sse2"), always_inline))
+inline __m128d load_sse2(const float *x) {
+    return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(x))));
+}
+
+__attribute__((target("avx"), always_inline))
+inline __m256d load_avx(const double *x) {
+    return _mm256_loadu_pd(x);
+}
+
+__attribute__((target("avx"), always_inline))
+inline __m256d load_avx(const float *x) {
+    return _mm256_cvtps_pd(_mm_loadu_ps(x));
+}
+
+__attribute__((target("avx512f"), always_inline))
+inline __m512d load_avx512(const double *x) {
+    return _mm512_loadu_pd(x);
+}
+
+__attribute__((target("avx512f"), always_inline))
+inline __m512d load_avx512(const float *x) {
+    // The masked form avoids a bogus -Wmaybe-uninitialized of GCC 12
+    return _mm512_maskz_cvtps_pd(0xFF, _mm256_loadu_ps(x));
+}
+
+template <typename Input>
+__attribute__((target("sse2")))
+uint64_t sum_8blocks_sse2(const Input *src, double *dst, const uint64_t n) {
+    uint64_t elementsWritten = 0;
+
+    uint64_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128d level2Sums[2];
+        for (int block = 0; block < 2; block++) {
+            const Input *x = &src[i + 8 * block];
+            const __m128d a = load_sse2(&x[0]);
+            const __m128d b = load_sse2(&x[2]);
+            const __m128d c = load_sse2(&x[4]);
+            const __m128d d = load_sse2(&x[6]);
+
+            // [x0 + x1, x2 + x3] and [x4 + x5, x6 + x7]
+            const __m128d level1A = _mm_add_pd(_mm_unpacklo_pd(a, b), _mm_unpackhi_pd(a, b));
+            const __m128d level1B = _mm_add_pd(_mm_unpacklo_pd(c, d), _mm_unpackhi_pd(c, d));
+
+            // [x0..3, x4..7]
+            level2Sums[block] = _mm_add_pd(_mm_unpacklo_pd(level1A, level1B),
+                    _mm_unpackhi_pd(level1A, level1B));
+        }
+
+        const __m128d level3Sums = _mm_add_pd(_mm_unpacklo_pd(level2Sums[0], level2Sums[1]),
+                _mm_unpackhi_pd(level2Sums[0], level2Sums[1]));
+
+        _mm_storeu_pd(&dst[elementsWritten], level3Sums);
+        elementsWritten += 2;
+    }
+
+    for (; i + 8 <= n; i += 8) {
+        const __m128d a = load_sse2(&src[i]);
+        const __m128d b = load_sse2(&src[i + 2]);
+        const __m128d c = load_sse2(&src[i + 4]);
+        const __m128d d = load_sse2(&src[i + 6]);
+
+        const __m128d level1A = _mm_add_pd(_mm_unpacklo_pd(a, b), _mm_unpackhi_pd(a, b));
+        const __m128d level1B = _mm_add_pd(_mm_unpacklo_pd(c, d), _mm_unpackhi_pd(c, d));
+
+        const __m128d level2Sum = _mm_add_pd(_mm_unpacklo_pd(level1A, level1B),
+                _mm_unpackhi_pd(level1A, level1B));
+
+        const __m128d level3Sum = _mm_add_sd(level2Sum, _mm_unpackhi_pd(level2Sum, level2Sum));
+
+        dst[elementsWritten++] = _mm_cvtsd_f64(level3Sum);
+    }
+
+    return elementsWritten;
+}
+
+template <typename Input>
+__attribute__((target("avx")))
+uint64_t sum_8blocks_avx(const Input *src, double *dst, const uint64_t n) {
+    uint64_t elementsWritten = 0;
+
+    uint64_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        // [x0 + x1, x4 + x5, x2 + x3, x6 + x7] of each of the four blocks
+        __m256d level1Sums[4];
+        for (int block = 0; block < 4; block++) {
+            const __m256d a = load_avx(&src[i + 8 * block]);
+            const __m256d b = load_avx(&src[i + 8 * block + 4]);
+            level1Sums[block] = _mm256_add_pd(_mm256_unpacklo_pd(a, b), _mm256_unpackhi_pd(a, b));
+        }
+
+        // Blocks 0 and 2 share a vector, as do 1 and 3, so that the last
+        // level yields all four sums in order: [x0..3, x4..7] of both blocks
+        const __m256d level2Sums02 = _mm256_add_pd(
+                _mm256_permute2f128_pd(level1Sums[0], level1Sums[2], 0x20),
+                _mm256_permute2f128_pd(level1Sums[0], level1Sums[2], 0x31));
+        const __m256d level2Sums13 = _mm256_add_pd(
+                _mm256_permute2f128_pd(level1Sums[1], level1Sums[3], 0x20),
+                _mm256_permute2f128_pd(level1Sums[1], level1Sums[3], 0x31));
+
+        const __m256d level3Sums = _mm256_add_pd(_mm256_unpacklo_pd(level2Sums02, level2Sums13),
+                _mm256_unpackhi_pd(level2Sums02, level2Sums13));
+
+        _mm256_storeu_pd(&dst[elementsWritten], level3Sums);
+        elementsWritten += 4;
+    }
+
+    for (; i + 8 <= n; i += 8) {
+        __m256d a = load_avx(&src[i]);
+        __m256d b = load_avx(&src[i+4]);
+        __m256d level1Sum = _mm256_hadd_pd(a, b);
+
+        __m128d c = _mm256_extractf128_pd(level1Sum, 1); // Fetch upper 128bit
+        __m128d d = _mm256_castpd256_pd128(level1Sum); // Fetch lower 128bit
+        __m128d level2Sum = _mm_add_pd(c, d);
+
+        __m128d level3Sum = _mm_hadd_pd(level2Sum, level2Sum);
+
+        dst[elementsWritten++] = _mm_cvtsd_f64(level3Sum);
+    }
+
+    return elementsWritten;
+}
+
+/*
+ * Sum the adjacent pairs of a and b: [a0 + a1, a2 + a3, ..., b6 + b7]
+ */
+__attribute__((target("avx512f"), always_inline))
+inline __m512d pairwise_avx512(const __m512d a, const __m512d b) {
+    const __m512i even = _mm512_set_epi64(14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i odd = _mm512_set_epi64(15, 13, 11, 9, 7, 5, 3, 1);
+
+    return _mm512_add_pd(_mm512_permutex2var_pd(a, even, b),
+            _mm512_permutex2var_pd(a, odd, b));
+}
+
+/*
+ * A vector holds 8 doubles, so the natural width for AVX-512 would be one
+ * 16-element block reduced by four levels. The tree would be the same, but
+ * the kernels are called by reduce_pass, which reduces three levels per pass
+ * and completes the block at the end of the buffer with sum_remaining_8tree,
+ * and BLOCK_LEVELS is aligned to the passes. A four level block would need all
+ * of them changed, so two 8-blocks are reduced side by side instead.
+ */
+template <typename Input>
+__attribute__((target("avx512f")))
+uint64_t sum_8blocks_avx512(const Input *src, double *dst, const uint64_t n) {
+    uint64_t elementsWritten = 0;
+
+    uint64_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        // Level 1 of blocks 2j and 2j + 1
+        __m512d level1Sums[4];
+        for (int j = 0; j < 4; j++) {
+            level1Sums[j] = pairwise_avx512(load_avx512(&src[i + 16 * j]),
+                    load_avx512(&src[i + 16 * j + 8]));
+        }
+
+        // [x0..3, x4..7] of blocks 0 to 3 and 4 to 7
+        const __m512d level2Sums0123 = pairwise_avx512(level1Sums[0], level1Sums[1]);
+        const __m512d level2Sums4567 = pairwise_avx512(level1Sums[2], level1Sums[3]);
+
+        _mm512_storeu_pd(&dst[elementsWritten], pairwise_avx512(level2Sums0123, level2Sums4567));
+        elementsWritten += 8;
+    }
+
+    for (; i + 16 <= n; i += 16) {
+        const __m512d level1Sum = pairwise_avx512(load_avx512(&src[i]), load_avx512(&src[i + 8]));
+        // [a0..3, a4..7, b0..3, b4..7] in the lower half
+        const __m512d level2Sum = pairwise_avx512(level1Sum, level1Sum);
+        // [a0..7, b0..7] in the lowest 128bit
+        const __m512d level3Sum = pairwise_avx512(level2Sum, level2Sum);
+
+        _mm512_mask_storeu_pd(&dst[elementsWritten], 0x3, level3Sum);
+        elementsWritten += 2;
+    }
+
+    return elementsWritten + sum_8blocks_avx(&src[i], &dst[elementsWritten], n - i);
+}
+
+/*
+ * Single precision kernels. Every shuffle pairs the even with the odd elements
+ * of two vectors, as pairwise_avx512 does for doubles.
+ */
+
+/*
+ * [a0 + a1, a2 + a3, b0 + b1, b2 + b3]
+ */
+__attribute__((target("sse2"), always_inline))
+inline __m128 pairwise_sse2(const __m128 a, const __m128 b) {
+    return _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+            _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+__attribute__((target("sse2")))
+uint64_t sum_8blocks_sse2(const float *src, float *dst, const uint64_t n) {
+    uint64_t elementsWritten = 0;
+
+    uint64_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        // [x0 + x1, x2 + x3, x4 + x5, x6 + x7] of each of the four blocks
+        __m128 level1Sums[4];
+        for (int block = 0; block < 4; block++) {
+            level1Sums[block] = pairwise_sse2(_mm_loadu_ps(&src[i + 8 * block]),
+                    _mm_loadu_ps(&src[i + 8 * block + 4]));
+        }
+
+        // [x0..3, x4..7] of blocks 0 and 1 and of blocks 2 and 3
+        const __m128 level2Sums01 = pairwise_sse2(level1Sums[0], level1Sums[1]);
+        const __m128 level2Sums23 = pairwise_sse2(level1Sums[2], level1Sums[3]);
+
+        _mm_storeu_ps(&dst[elementsWritten], pairwise_sse2(level2Sums01, level2Sums23));
+        elementsWritten += 4;
+    }
+
+    return elementsWritten + sum_8blocks_scalar(&src[i], &dst[elementsWritten], n - i);
+}
+
+/*
+ * [a0 + a1, a2 + a3, b0 + b1, b2 + b3 | a4 + a5, a6 + a7, b4 + b5, b6 + b7]
+ */
+__attribute__((target("avx"), always_inline))
+inline __m256 pairwise_avx(const __m256 a, const __m256 b) {
+    return _mm256_add_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+            _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+__attribute__((target("avx")))
+uint64_t sum_8blocks_avx(const float *src, float *dst, const uint64_t n) {
+    uint64_t elementsWritten = 0;
+
+    uint64_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        // Level 1 of blocks 2j and 2j + 1
+        __m256 level1Sums[4];
+        for (int j = 0; j < 4; j++) {
+            level1Sums[j] = pairwise_avx(_mm256_loadu_ps(&src[i + 16 * j]),
+                    _mm256_loadu_ps(&src[i + 16 * j + 8]));
+        }
+
+        // [x0..3 | x4..7] of blocks 0 to 3 and of blocks 4 to 7
+        const __m256 level2Sums0123 = pairwise_avx(level1Sums[0], level1Sums[1]);
+        const __m256 level2Sums4567 = pairwise_avx(level1Sums[2], level1Sums[3]);
+
+        const __m256 level3Sums = _mm256_add_ps(
+                _mm256_permute2f128_ps(level2Sums0123, level2Sums4567, 0x20),
+                _mm256_permute2f128_ps(level2Sums0123, level2Sums4567, 0x31));
+
+        _mm256_storeu_ps(&dst[elementsWritten], level3Sums);
+        elementsWritten += 8;
+    }
+
+    return elementsWritten + sum_8blocks_sse2(&src[i], &dst[elementsWritten], n - i);
+}
+
+/*
+ * [a0 + a1, a2 + a3, ..., b14 + b15]
+ */
+__attribute__((target("avx512f"), always_inline))
+inline __m512 pairwise_avx512(const __m512 a, const __m512 b) {
+    const __m512i even = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i odd = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+
+    return _mm512_add_ps(_mm512_permutex2var_ps(a, even, b),
+            _mm512_permutex2var_ps(a, odd, b));
+}
+
+__attribute__((target("avx512f")))
+uint64_t sum_8blocks_avx512(const float *src, float *dst, const uint64_t n) {
+    uint64_t elementsWritten = 0;
+
+    uint64_t i = 0;
+    for (; i + 128 <= n; i += 128) {
+        // Level 1 of blocks 4j to 4j + 3
+        __m512 level1Sums[4];
+        for (int j = 0; j < 4; j++) {
+            level1Sums[j] = pairwise_avx512(_mm512_loadu_ps(&src[i + 32 * j]),
+                    _mm512_loadu_ps(&src[i + 32 * j + 16]));
+        }
+
+        // [x0..3, x4..7] of blocks 0 to 7 and 8 to 15
+        const __m512 level2Sums0to7 = pairwise_avx512(level1Sums[0], level1Sums[1]);
+        const __m512 level2Sums8to15 = pairwise_avx512(level1Sums[2], level1Sums[3]);
+
+        _mm512_storeu_ps(&dst[elementsWritten], pairwise_avx512(level2Sums0to7, level2Sums8to15));
+        elementsWritten += 16;
+    }
+
+    return elementsWritten + sum_8blocks_avx(&src[i], &dst[elementsWritten], n - i);
+}
+#endif
+
+#if defined(__aarch64__)
+inline float64x2_t load_neon(const double *x) {
+    return vld1q_f64(x);
+}
+
+inline float64x2_t load_neon(const float *x) {
+    return vcvt_f64_f32(vld1_f32(x));
+}
+
+template <typename Input>
+uint64_t sum_8blocks_neon(const Input *src, double *dst, const uint64_t n) {
+    uint64_t elementsWritten = 0;
+
+    uint64_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        float64x2_t level2Sums[2];
+        for (int block = 0; block < 2; block++) {
+            const Input *x = &src[i + 8 * block];
+            const float64x2_t level1A = vpaddq_f64(load_neon(&x[0]), load_neon(&x[2]));
+            const float64x2_t level1B = vpaddq_f64(load_neon(&x[4]), load_neon(&x[6]));
+            level2Sums[block] = vpaddq_f64(level1A, level1B);
+        }
+
+        vst1q_f64(&dst[elementsWritten], vpaddq_f64(level2Sums[0], level2Sums[1]));
+        elementsWritten += 2;
+    }
+
+    for (; i + 8 <= n; i += 8) {
+        const float64x2_t level1A = vpaddq_f64(load_neon(&src[i]), load_neon(&src[i + 2]));
+        const float64x2_t level1B = vpaddq_f64(load_neon(&src[i + 4]), load_neon(&src[i + 6]));
+        const float64x2_t level2Sum = vpaddq_f64(level1A, level1B);
+
+        dst[elementsWritten++] = vpaddd_f64(level2Sum);
+    }
+
+    return elementsWritten;
+}
+
+uint64_t sum_8blocks_neon(const float *src, float *dst, const uint64_t n) {
+    uint64_t elementsWritten = 0;
+
+    uint64_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        // [x0 + x1, x2 + x3, x4 + x5, x6 + x7] of each of the four blocks
+        float32x4_t level1Sums[4];
+        for (int block = 0; block < 4; block++) {
+            level1Sums[block] = vpaddq_f32(vld1q_f32(&src[i + 8 * block]),
+                    vld1q_f32(&src[i + 8 * block + 4]));
+        }
+
+        const float32x4_t level2Sums01 = vpaddq_f32(level1Sums[0], level1Sums[1]);
+        const float32x4_t level2Sums23 = vpaddq_f32(level1Sums[2], level1Sums[3]);
+
+        vst1q_f32(&dst[elementsWritten], vpaddq_f32(level2Sums01, level2Sums23));
+        elementsWritten += 4;
+    }
+
+    return elementsWritten + sum_8blocks_scalar(&src[i], &dst[elementsWritten], n - i);
+}
+#endif
+
+/*
+ * Natural logarithm following fdlibm: x = 2^e * m with m in [sqrt(2) / 2,
+ * sqrt(2)), f = m - 1, s = f / (2 + f) and log(m) = f - f^2 / 2 + s (f^2 / 2 + R(s^2)).
+ * Branch-free, so the loops below are vectorised. This file is compiled with
+ * -ffp-contract=off, so no product is fused into a multiply-add even where
+ * FMA is available and every variant rounds the same way.
+ */
+inline double log_double(const double input) {
+    constexpr double ln2Hi = 6.93147180369123816490e-01;
+    constexpr double ln2Lo = 1.90821492927058770002e-10;
+    constexpr double Lg1 = 6.666666666666735130e-01;
+    constexpr double Lg2 = 3.999999999940941908e-01;
+    constexpr double Lg3 = 2.857142874366239149e-01;
+    constexpr double Lg4 = 2.222219843214978396e-01;
+    constexpr double Lg5 = 1.818357216161805012e-01;
+    constexpr double Lg6 = 1.531383769920937332e-01;
+    constexpr double Lg7 = 1.479819860511658591e-01;
+
+    // Subnormal numbers are scaled by 2^54 into the normal range. Both sides of
+    // every selection are computed, the compiler must not speculate them.
+    const bool subnormal = input < std::numeric_limits<double>::min();
+    const double scaled = input * 18014398509481984.0;
+    const double x = subnormal ? scaled : input;
+    const uint64_t bits = std::bit_cast<uint64_t>(x);
+
+    // The biased exponent is converted exactly through the mantissa of 2^52
+    const double bias = subnormal ? 1077.0 : 1023.0;
+    const double biasedExponent = std::bit_cast<double>((bits >> 52) | 0x4330000000000000UL)
+        - 4503599627370496.0;
+    const double mantissa = std::bit_cast<double>((bits & 0x000FFFFFFFFFFFFFUL) | 0x3FF0000000000000UL);
+    const bool large = mantissa > 1.41421356237309504880;
+    const double halfMantissa = 0.5 * mantissa;
+    const double m = large ? halfMantissa : mantissa;
+    const double e = biasedExponent - (large ? bias - 1.0 : bias);
+
+    const double f = m - 1.0;
+    const double s = f / (2.0 + f);
+    const double z = s * s;
+    const double w = z * z;
+    const double R = z * (Lg1 + w * (Lg3 + w * (Lg5 + w * Lg7))) + w * (Lg2 + w * (Lg4 + w * Lg6));
+    const double hfsq = 0.5 * f * f;
+    double result = e * ln2Hi - ((hfsq - (s * (hfsq + R) + e * ln2Lo)) - f);
+
+    result = (input == std::numeric_limits<double>::infinity()) ? input : result;
+    result = (input == 0.0) ? -std::numeric_limits<double>::infinity() : result;
+    result = (input < 0.0) | (input != input) ? std::numeric_limits<double>::quiet_NaN() : result;
+    return result;
+}
+
+template <typename Input, typename Accumulator>
+__attribute__((always_inline))
+inline void log_loop(const Input *in, Accumulator *out, const size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = Accumulator(log_double(in[i]));
+    }
+}
+
+template <typename Input, typename Accumulator>
+void log_default(const Input *in, Accumulator *out, const size_t n) {
+    log_loop(in, out, n);
+}
+
+#ifdef BINARYTREE_SUMMATION_X86
+// AVX2 for the integer operations on 4 lanes. FMA stays disabled.
+template <typename Input, typename Accumulator>
+__attribute__((target("avx2")))
+void log_avx2(const Input *in, Accumulator *out, const size_t n) {
+    log_loop(in, out, n);
+}
+#endif
+
+double LogTransform::operator()(const double x) const {
+    return log_double(x);
+}
+
+float LogTransform::operator()(const float x) const {
+    return log_double(x);
+}
+
+template <typename Input, typename Accumulator>
+void log_transform(const Input *in, Accumulator *out, const size_t n, void *) {
+#ifdef BINARYTREE_SUMMATION_X86
+    static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+    if (avx2) {
+        log_avx2(in, out, n);
+        return;
+    }
+#endif
+    log_default(in, out, n);
+}
+
+template void log_transform<double, double>(const double *, double *, const size_t, void *);
+template void log_transform<float, double>(const float *, double *, const size_t, void *);
+template void log_transform<float, float>(const float *, float *, const size_t, void *);
+
+SimdKernel best_simd_kernel() {
+#ifdef BINARYTREE_SUMMATION_X86
+    // May run during static initialization, before the CPU model is known
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) return SimdKernel::AVX512;
+    if (__builtin_cpu_supports("avx")) return SimdKernel::AVX;
+    if (__builtin_cpu_supports("sse2")) return SimdKernel::SSE2;
+#endif
+#if defined(__aarch64__)
+    return SimdKernel::NEON;
+#endif
+    return SimdKernel::Scalar;
+}
+
+template <typename Input, typename Accumulator>
+sum_8blocks_kernel<Input, Accumulator> select_sum_8blocks_kernel(const SimdKernel kernel) {
+    using Kernel = sum_8blocks_kernel<Input, Accumulator>;
+#ifdef BINARYTREE_SUMMATION_X86
+    __builtin_cpu_init();
+#endif
+
+    switch (kernel) {
+        case SimdKernel::Auto:
+            return select_sum_8blocks_kernel<Input, Accumulator>(best_simd_kernel());
+        case SimdKernel::Scalar:
+            return sum_8blocks_scalar<Input, Accumulator>;
+#ifdef BINARYTREE_SUMMATION_X86
+        case SimdKernel::SSE2:
+            return __builtin_cpu_supports("sse2") ? static_cast<Kernel>(sum_8blocks_sse2) : nullptr;
+        case SimdKernel::AVX:
+            return __builtin_cpu_supports("avx") ? static_cast<Kernel>(sum_8blocks_avx) : nullptr;
+        case SimdKernel::AVX512:
+            return __builtin_cpu_supports("avx512f") ? static_cast<Kernel>(sum_8blocks_avx512) : nullptr;
+#endif
+#if defined(__aarch64__)
+        case SimdKernel::NEON:
+            return static_cast<Kernel>(sum_8blocks_neon);
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+template sum_8blocks_kernel<double, double> select_sum_8blocks_kernel<double, double>(const SimdKernel kernel);
+template sum_8blocks_kernel<float, double> select_sum_8blocks_kernel<float, double>(const SimdKernel kernel);
+template sum_8blocks_kernel<float, float> select_sum_8blocks_kernel<float, float>(const SimdKernel kernel);
@@ -0,0 +1,30 @@
+#ifndef BINARYTREE_SUMMATION_KERNELS_H_
+#define BINARYTREE_SUMMATION_KERNELS_H_
+
+#include <stdint.h>
+#include "binarytreesummation.h"
+
+/**
+ * Reduce all complete blocks of 8 elements in src by three tree levels and
+ * return the number of partial sums written to dst. The elements are converted
+ * to Accumulator, block j is summed as
+ * ((x0 + x1) + (x2 + x3)) + ((x4 + x5) + (x6 + x7)) and written to dst[j], so
+ * dst may alias src if both have the same type.
+ */
+template <typename Input, typename Accumulator>
+using sum_8blocks_kernel = uint64_t (*)(const Input *src, Accumulator *dst, const uint64_t n);
+
+/**
+ * Return the implementation of the given kernel, or nullptr if the CPU does not
+ * support it. SimdKernel::Auto resolves to the widest supported kernel.
+ * Available for double -> double, float -> double and float -> float.
+ */
+template <typename Input, typename Accumulator>
+sum_8blocks_kernel<Input, Accumulator> select_sum_8blocks_kernel(const SimdKernel kernel);
+
+/**
+ * Resolve SimdKernel::Auto to the widest kernel supported by the CPU.
+ */
+SimdKernel best_simd_kernel();
+
+#endif
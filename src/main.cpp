@@ -5,6 +5,7 @@
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
 #include "mpi.h"
 #include "binarytreesummation.h"
 #include "io.hpp"
@@ -33,29 +34,96 @@ void attach_debugger(bool condition) {
 
 int main(int argc, char** argv) {
     MPI_Init(&argc, &argv);
-    if (argc != 2) {
-        cerr << "Usage: " << argv[0] << "file.binpsllh|file.psllh" << endl;
+    bool use_mpiio = false;
+    bool use_mmap = false;
+    bool use_stream = false;
+    bool use_block_sums = false;
+    bool verify = false;
+    string filename;
+
+    for (int i = 1; i < argc; i++) {
+        const string arg(argv[i]);
+        if (arg == "--mpiio") {
+            use_mpiio = true;
+        } else if (arg == "--mmap") {
+            use_mmap = true;
+        } else if (arg == "--stream") {
+            use_stream = true;
+        } else if (arg == "--block-sums") {
+            use_block_sums = true;
+        } else if (arg == "--verify") {
+            verify = true;
+        } else if (filename.empty()) {
+            filename = arg;
+        } else {
+            filename.clear();
+            break;
+        }
+    }
+
+    if (filename.empty()) {
+        cerr << "Usage: " << argv[0] << " [--mpiio|--mmap|--stream] file.binpsllh" << endl;
+        cerr << "       " << argv[0] << " file.psllh" << endl;
+        cerr << "       " << argv[0] << " [--stream] [--block-sums] [--verify] file.cbpsllh" << endl;
+        cerr << "       " << argv[0] << " [--mpiio] file.zbpsllh" << endl;
+        return -1;
+    }
+
+    // Only .binpsllh files hold the elements in memory order and can be mapped
+    if (use_mmap && !filename.ends_with(".binpsllh")) {
+        cerr << "--mmap requires a .binpsllh file" << endl;
+        MPI_Finalize();
         return -1;
     }
 
-    string filename(argv[1]);
+    int rank, comm_size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
 
+    // Only the elements of this rank are kept in data, N is the global count.
     std::vector<double> data;
+    std::unique_ptr<IO::BinpsllhMapping> mapping;
+    std::unique_ptr<IO::BinpsllhStream> stream;
+    std::unique_ptr<IO::CbpsllhFile> chunked;
+    uint64_t N;
 
     if (filename.ends_with(".psllh")) {
-        data = IO::read_psllh(filename);
+        data = IO::read_psllh(filename, MPI_COMM_WORLD, N);
     } else if (filename.ends_with(".binpsllh")) {
-        data = IO::read_binpsllh(filename);
+        if (use_stream) {
+            stream = std::make_unique<IO::BinpsllhStream>(filename, rank, comm_size);
+            N = stream->num_entries();
+        } else if (use_mmap) {
+            mapping = std::make_unique<IO::BinpsllhMapping>(filename, rank, comm_size);
+            N = mapping->num_entries();
+        } else if (use_mpiio) {
+            data = IO::read_binpsllh_mpiio(filename, MPI_COMM_WORLD, N);
+        } else {
+            data = IO::read_binpsllh(filename, rank, comm_size, N);
+        }
+    } else if (filename.ends_with(".cbpsllh")) {
+        chunked = std::make_unique<IO::CbpsllhFile>(filename, rank, comm_size, use_block_sums);
+        N = chunked->num_entries();
+        if (verify && !chunked->verify()) {
+            cerr << "[ERROR] Checksum mismatch in " << filename << " on rank " << rank << endl;
+            MPI_Abort(MPI_COMM_WORLD, -3);
+        }
+        if (!use_stream && !use_block_sums) {
+            data.resize(chunked->size());
+            for (size_t i = 0; i < data.size();) {
+                i += chunked->read(data.data() + i, data.size() - i);
+            }
+            chunked.reset();
+        }
+    } else if (filename.ends_with(".zbpsllh")) {
+        data = use_mpiio ? IO::read_zbpsllh_mpiio(filename, MPI_COMM_WORLD, N)
+            : IO::read_zbpsllh(filename, rank, comm_size, N);
     } else {
-        cerr << "File must end with .psllh or .binpsllh" << endl;
+        cerr << "File must end with .psllh, .binpsllh, .cbpsllh or .zbpsllh" << endl;
         return -2;
     }
 
-    cout << "Summing " << data.size() << " summands" << endl;
-
-    int rank, comm_size;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    cout << "Summing " << N << " summands" << endl;
 
     char *debug_rank_str = std::getenv("MPI_DEBUG_RANK");
     if(debug_rank_str != NULL) {
@@ -65,9 +133,24 @@ int main(int argc, char** argv) {
     }
 
 
-    uint64_t start_index = startIndex(rank, data.size(), comm_size);
-
-    double result = binary_tree_sum(&data[start_index], data.size());
+    // The mapped input is read-only, it is reduced without being modified.
+    // The streamed input is never held in memory as a whole.
+    double result;
+    if (chunked) {
+        // The stored sums of the local blocks replace their elements
+        ReductionPlan plan(N);
+        result = binary_tree_sum_stream([&](double *buffer, const size_t capacity) {
+            return chunked->read(buffer, capacity);
+        }, chunked->block_sums(), plan);
+    } else if (stream) {
+        result = binary_tree_sum_stream([&](double *buffer, const size_t capacity) {
+            return stream->read(buffer, capacity);
+        }, N);
+    } else if (mapping) {
+        result = binary_tree_sum(mapping->data(), N);
+    } else {
+        result = binary_tree_sum(data.data(), N);
+    }
 
     printf("%.32f\n", result);
     MPI_Finalize();
@@ -0,0 +1,191 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mpi.h>
+#include "binarytreesummation.h"
+#include "generator.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+/*
+ * Scaling benchmark of binary_tree_sum across the ranks of MPI_COMM_WORLD.
+ * For every rank count p and number of elements N the first p ranks reduce N
+ * elements in a communicator of their own. Every call starts after a barrier.
+ *
+ * Reported per configuration:
+ *  - the mean latency of a call on the fastest and the slowest rank,
+ *  - the local compute time of the slowest rank and the remainder of its call
+ *    spent waiting for other ranks. Measured by get_sum_statistics if the
+ *    library collects statistics, otherwise the compute time is estimated by
+ *    reducing the slice of the rank alone,
+ *  - the point-to-point messages and bytes sent per call by all ranks, the
+ *    broadcast of the result is not included.
+ */
+
+static vector<uint64_t> parse_list(const string &list) {
+    vector<uint64_t> values;
+    size_t begin = 0;
+    while (begin < list.size()) {
+        size_t end = list.find(',', begin);
+        if (end == string::npos) end = list.size();
+        values.push_back(std::strtoull(list.substr(begin, end - begin).c_str(), nullptr, 10));
+        begin = end + 1;
+    }
+    return values;
+}
+
+/*
+ * Mean time of a call of sum after a few warm-up calls, every call starts after
+ * a barrier of comm.
+ */
+template <typename F>
+static double mean_time(MPI_Comm comm, const int iterations, F &&sum) {
+    for (int i = 0; i < 3; i++) sum();
+
+    double total = 0.0;
+    for (int i = 0; i < iterations; i++) {
+        MPI_Barrier(comm);
+        const double start = MPI_Wtime();
+        sum();
+        total += MPI_Wtime() - start;
+    }
+    return total / iterations;
+}
+
+static void run(const int p, const uint64_t N, const int iterations, const bool aligned) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    MPI_Comm comm;
+    MPI_Comm_split(MPI_COMM_WORLD, rank < p ? 0 : MPI_UNDEFINED, rank, &comm);
+    if (comm == MPI_COMM_NULL) return;
+
+    const Distribution distribution = aligned ? aligned_distribution(N, p, 0.01)
+        : Distribution(N, p);
+    vector<double> data(distribution.end(rank) - distribution.begin(rank));
+    for (uint64_t i = 0; i < data.size(); i++) {
+        data[i] = element(distribution.begin(rank) + i);
+    }
+
+    BinaryTreeSumWorkspace workspace(data.size());
+    double latency;
+    uint64_t messages;
+    {
+        ReductionPlan plan(distribution, comm, 0, ResultMode::AllRanks, false);
+        messages = plan.outgoing_summands();
+        latency = mean_time(comm, iterations, [&] {
+            return binary_tree_sum(data.data(), plan, workspace);
+        });
+    }
+
+    double compute;
+#ifdef BINARY_TREE_SUMMATION_STATS
+    {
+        ReductionPlan plan(distribution, comm, 0, ResultMode::AllRanks, false);
+        reset_sum_statistics();
+        mean_time(comm, iterations, [&] {
+            return binary_tree_sum(data.data(), plan, workspace);
+        });
+        const SumStatistics statistics = get_sum_statistics();
+        compute = (statistics.totalTime - statistics.receiveWaitTime - statistics.sendTime
+                - statistics.resultTime) / statistics.calls;
+    }
+#else
+    {
+        ReductionPlan plan(data.size(), MPI_COMM_SELF);
+        compute = mean_time(MPI_COMM_SELF, iterations, [&] {
+            return binary_tree_sum(data.data(), plan, workspace);
+        });
+    }
+#endif
+
+    struct {
+        double latency;
+        int rank;
+    } slowest {latency, rank};
+    double fastest;
+    uint64_t totalMessages;
+    MPI_Allreduce(MPI_IN_PLACE, &slowest, 1, MPI_DOUBLE_INT, MPI_MAXLOC, comm);
+    MPI_Reduce(&latency, &fastest, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(&messages, &totalMessages, 1, MPI_UINT64_T, MPI_SUM, 0, comm);
+
+    // Split of the slowest rank
+    if (slowest.rank != 0 && rank == slowest.rank) {
+        MPI_Send(&compute, 1, MPI_DOUBLE, 0, 0, comm);
+    } else if (slowest.rank != 0 && rank == 0) {
+        MPI_Recv(&compute, 1, MPI_DOUBLE, slowest.rank, 0, comm, MPI_STATUS_IGNORE);
+    }
+
+    if (rank == 0) {
+        printf("%6d %12lu %12.2f %12.2f %12.2f %12.2f %10lu %10lu\n", p, N,
+                1e6 * fastest, 1e6 * slowest.latency, 1e6 * compute,
+                1e6 * std::max(0.0, slowest.latency - compute),
+                totalMessages, totalMessages * sizeof(double));
+        fflush(stdout);
+    }
+
+    MPI_Comm_free(&comm);
+}
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    int rank, worldSize;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+
+    vector<uint64_t> rankCounts;
+    vector<uint64_t> sizes = {1000, 10000, 100000, 1000000, 10000000, 100000000};
+    int iterations = 50;
+    bool aligned = false;
+
+    for (int i = 1; i < argc; i++) {
+        const string arg(argv[i]);
+        if (arg == "--ranks" && i + 1 < argc) {
+            rankCounts = parse_list(argv[++i]);
+        } else if (arg == "--sizes" && i + 1 < argc) {
+            sizes = parse_list(argv[++i]);
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::atoi(argv[++i]);
+        } else if (arg == "--aligned") {
+            aligned = true;
+        } else {
+            if (rank == 0) {
+                cerr << "Usage: " << argv[0] << " [--ranks p1,p2,...] [--sizes N1,N2,...]"
+                    << " [--iterations I] [--aligned]" << endl;
+            }
+            MPI_Finalize();
+            return -1;
+        }
+    }
+
+    // Powers of two up to the size of MPI_COMM_WORLD and the size itself
+    if (rankCounts.empty()) {
+        for (int p = 1; p < worldSize; p *= 2) rankCounts.push_back(p);
+        rankCounts.push_back(worldSize);
+    }
+
+    if (rank == 0) {
+        printf("%6s %12s %12s %12s %12s %12s %10s %10s\n", "ranks", "N", "min_us", "max_us",
+                "compute_us", "wait_us", "messages", "bytes");
+    }
+
+    for (const uint64_t p : rankCounts) {
+        if (p < 1 || p > static_cast<uint64_t>(worldSize)) {
+            if (rank == 0) cerr << "Skipping " << p << " ranks, MPI_COMM_WORLD has " << worldSize << endl;
+            continue;
+        }
+        for (const uint64_t N : sizes) {
+            run(p, N, iterations, aligned);
+            MPI_Barrier(MPI_COMM_WORLD);
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
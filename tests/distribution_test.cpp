@@ -0,0 +1,75 @@
+#include <iostream>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <initializer_list>
+#include "binarytreesummation.h"
+
+using std::cerr;
+using std::endl;
+
+/*
+ * Slice bounds of the even_remainder_at_end distribution, including N beyond
+ * the range of int, and of aligned_distribution.
+ */
+
+static int failures = 0;
+
+static void check(const bool condition, const char *what, const uint64_t N, const int p) {
+    if (!condition) {
+        cerr << "[ERROR] " << what << " for N = " << N << ", p = " << p << endl;
+        failures++;
+    }
+}
+
+int main() {
+    for (const uint64_t N : {0UL, 1UL, 7UL, 1000UL, 1UL << 31, (1UL << 31) + 3, 1UL << 32,
+            (1UL << 32) + 5, 3UL << 33, (1UL << 40) + 12345}) {
+        for (const int p : {1, 2, 3, 4, 7, 64, 1000}) {
+            check(startIndex(0, N, p) == 0, "start of rank 0", N, p);
+            check(startIndex(p, N, p) == N, "end of the last rank", N, p);
+
+            const uint64_t floor = N / p;
+            for (int rank = 0; rank < p; rank++) {
+                const uint64_t size = startIndex(rank + 1, N, p) - startIndex(rank, N, p);
+                check(size == floor || size == floor + 1, "slice size", N, p);
+            }
+
+            const Distribution distribution(N, p);
+            for (int rank = 0; rank < p; rank++) {
+                if (distribution.begin(rank) == distribution.end(rank)) continue;
+                check(distribution.rank_of(distribution.begin(rank)) == rank, "rank_of", N, p);
+                check(distribution.rank_of(distribution.end(rank) - 1) == rank, "rank_of", N, p);
+            }
+        }
+    }
+
+    // Aligned boundaries stay sorted, within the slack of the even ones, and
+    // only stay at index 0 if the even ones are there, also for N < p and
+    // tolerances that allow empty ranks
+    for (const uint64_t N : {0UL, 1UL, 3UL, 7UL, 1000UL, 65553UL, (1UL << 32) + 5}) {
+        for (const int p : {1, 2, 3, 4, 7, 64}) {
+            for (const double tolerance : {0.0, 0.1, 1.0, 1.5, 4.0, 1e9, -1.0}) {
+                const Distribution aligned = aligned_distribution(N, p, tolerance);
+                const double slack = std::max(0.0, tolerance) * N / (2 * p);
+                check(aligned.size() == N && aligned.ranks() == p, "aligned size", N, p);
+                check(aligned.begin(0) == 0 && aligned.end(p - 1) == N, "aligned bounds", N, p);
+                for (int rank = 1; rank < p; rank++) {
+                    const uint64_t begin = aligned.begin(rank);
+                    const uint64_t ideal = startIndex(rank, N, p);
+                    check(aligned.end(rank - 1) == begin, "aligned ranks adjacent", N, p);
+                    check(aligned.begin(rank - 1) <= begin, "aligned offsets sorted", N, p);
+                    check(std::abs(double(begin) - double(ideal)) <= slack, "aligned within slack", N, p);
+                    check(begin > 0 || ideal == 0, "aligned boundary at 0", N, p);
+                }
+            }
+        }
+    }
+
+    // Reported regressions, the bound of the last rank overflowed an int
+    check(startIndex(4, 1UL << 32, 4) == 1UL << 32, "startIndex(4, 2^32, 4)", 1UL << 32, 4);
+    check(startIndex(4, 1UL << 31, 4) == 1UL << 31, "startIndex(4, 2^31, 4)", 1UL << 31, 4);
+    check(startIndex(3, 1UL << 32, 4) == 3UL << 30, "startIndex(3, 2^32, 4)", 1UL << 32, 4);
+
+    return failures == 0 ? 0 : 1;
+}
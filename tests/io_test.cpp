@@ -0,0 +1,291 @@
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <initializer_list>
+#include <unistd.h>
+#include <mpi.h>
+#include "binarytreesummation.h"
+#include "generator.h"
+#include "io.hpp"
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+/*
+ * The readers of the input formats against the elements written to the file:
+ * every rank must get exactly startIndex(rank) .. startIndex(rank + 1) of
+ * them, bit for bit. Runs on any number of ranks.
+ */
+
+static int rank, p;
+static int failures = 0;
+static std::filesystem::path directory;
+
+static void check(const bool condition, const string &what, const string &context) {
+    if (!condition) {
+        cerr << "[ERROR] rank " << rank << ": " << what << " (" << context << ")" << endl;
+        failures++;
+    }
+}
+
+static bool equal(const double *a, const size_t n, const vector<double> &b) {
+    return n == b.size() && (n == 0 || std::memcmp(a, b.data(), sizeof(double) * n) == 0);
+}
+
+static vector<double> slice(const vector<double> &x) {
+    return vector<double>(x.begin() + startIndex(rank, x.size(), p),
+            x.begin() + startIndex(rank + 1, x.size(), p));
+}
+
+/*
+ * Run write on rank 0 once no rank reads the previous file, all ranks return
+ * after the file is complete.
+ */
+template <typename Write>
+static void write_on_root(Write write) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (rank == 0) write();
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/*
+ * Write x as .binpsllh with the given header count.
+ */
+static string write_binpsllh(const string &name, const vector<double> &x, const uint64_t count) {
+    const string path = directory / name;
+    write_on_root([&] {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        file.write(reinterpret_cast<const char *>(x.data()), sizeof(double) * x.size());
+    });
+    return path;
+}
+
+/*
+ * The readers of .binpsllh files.
+ */
+static void check_binpsllh(const vector<double> &x, const uint64_t count, const string &context) {
+    const string path = write_binpsllh("input.binpsllh", x, count);
+    const vector<double> expected = slice(x);
+
+    uint64_t N = 0;
+    const vector<double> local = IO::read_binpsllh(path, rank, p, N);
+    check(N == x.size() && equal(local.data(), local.size(), expected), "read_binpsllh", context);
+
+    N = 0;
+    const vector<double> collective = IO::read_binpsllh_mpiio(path, MPI_COMM_WORLD, N);
+    check(N == x.size() && equal(collective.data(), collective.size(), expected),
+            "read_binpsllh_mpiio", context);
+
+    IO::BinpsllhMapping mapping(path, rank, p);
+    check(mapping.num_entries() == x.size() && equal(mapping.data(), mapping.size(), expected),
+            "BinpsllhMapping", context);
+
+    IO::BinpsllhStream stream(path, rank, p);
+    vector<double> streamed(stream.size());
+    for (size_t i = 0; i < streamed.size();) {
+        const size_t n = stream.read(streamed.data() + i, 3);
+        if (n == 0) break;
+        i += n;
+    }
+    check(stream.num_entries() == x.size() && stream.read(streamed.data(), 1) == 0
+            && equal(streamed.data(), streamed.size(), expected), "BinpsllhStream", context);
+}
+
+/*
+ * The readers of .psllh files against the serial one. The entries are
+ * separated by varying whitespace and written with all their digits, so with
+ * few elements the byte shares of the collective reader are empty on some
+ * ranks and cut through numbers on others.
+ */
+static void check_psllh(const vector<double> &x, const uint64_t count, const string &context) {
+    const string path = directory / "input.psllh";
+    write_on_root([&] {
+        std::ofstream file(path, std::ios::trunc);
+        file << count << "\n";
+        for (size_t i = 0; i < x.size(); i++) {
+            char entry[32];
+            std::snprintf(entry, sizeof(entry), "%.17g", x[i]);
+            file << entry << ((i % 5 == 4) ? "\n" : (i % 3 == 0) ? " \t " : " ");
+        }
+    });
+
+    const vector<double> serial = IO::read_psllh(path);
+    check(equal(serial.data(), serial.size(), x), "read_psllh(path)", context);
+    const vector<double> expected = slice(x);
+
+    for (const unsigned int threads : {1u, 3u}) {
+        const string threadContext = context + ", " + std::to_string(threads) + " threads";
+        uint64_t N = 0;
+        const vector<double> local = IO::read_psllh(path, rank, p, N, threads);
+        check(N == x.size() && equal(local.data(), local.size(), expected),
+                "read_psllh(path, rank, p)", threadContext);
+
+        N = 0;
+        const vector<double> collective = IO::read_psllh(path, MPI_COMM_WORLD, N, threads);
+        check(N == x.size() && equal(collective.data(), collective.size(), expected),
+                "read_psllh(path, comm)", threadContext);
+    }
+}
+
+/*
+ * Elements of the rank from reader.read, called with a small capacity.
+ */
+template <typename Reader>
+static vector<double> read_all(Reader &reader) {
+    vector<double> local;
+    double buffer[5];
+    while (const size_t n = reader.read(buffer, 5)) local.insert(local.end(), buffer, buffer + n);
+    return local;
+}
+
+/*
+ * .cbpsllh files with blocks of 2^levels elements, which straddle the rank
+ * boundaries for most N and p. The sum with the stored block sums must equal
+ * binary_tree_sum of the elements, bit for bit.
+ */
+static void check_cbpsllh(const vector<double> &x, const int levels, const string &context) {
+    const uint64_t N = x.size();
+    const string path = directory / "input.cbpsllh";
+    write_on_root([&] { IO::write_cbpsllh(path, x, levels); });
+    const vector<double> expected = slice(x);
+    const double expectedSum = binary_tree_sum(expected.data(), N);
+
+    for (const bool useBlockSums : {false, true}) {
+        const string sumsContext = context + (useBlockSums ? ", block sums" : "");
+        IO::CbpsllhFile file(path, rank, p, useBlockSums);
+        check(file.num_entries() == N && file.size() == expected.size()
+                && file.block_levels() == levels, "CbpsllhFile header", sumsContext);
+        check(file.verify(), "CbpsllhFile::verify", sumsContext);
+        check(useBlockSums || file.block_sums().empty(), "CbpsllhFile::block_sums", sumsContext);
+
+        ReductionPlan plan(N);
+        const double sum = binary_tree_sum_stream([&](double *buffer, const size_t capacity) {
+            return file.read(buffer, capacity);
+        }, file.block_sums(), plan, 100);
+        check(std::memcmp(&sum, &expectedSum, sizeof(sum)) == 0,
+                "binary_tree_sum_stream(CbpsllhFile)", sumsContext);
+    }
+
+    IO::CbpsllhFile file(path, rank, p);
+    const vector<double> local = read_all(file);
+    check(equal(local.data(), local.size(), expected), "CbpsllhFile::read", context);
+
+    // Flip a bit of the first element, only the ranks reading its block notice
+    write_on_root([&] {
+        std::fstream stream(path, std::ios::binary | std::ios::in | std::ios::out);
+        stream.seekg(4096);
+        char byte = static_cast<char>(stream.get());
+        stream.seekp(4096);
+        stream.put(byte ^ 1);
+    });
+    const uint64_t begin = startIndex(rank, N, p);
+    const uint64_t end = startIndex(rank + 1, N, p);
+    const bool readsFirstBlock = begin < end && begin < (1UL << levels);
+    IO::CbpsllhFile flipped(path, rank, p);
+    check(flipped.verify() != readsFirstBlock, "CbpsllhFile::verify after flipping a bit", context);
+}
+
+/*
+ * .zbpsllh files written for 3 ranks with the given codec, read on any number
+ * of ranks by the rank-local and the MPI-IO reader. The sums of the slices
+ * must equal binary_tree_sum of the elements, bit for bit.
+ */
+static void check_zbpsllh(const vector<double> &x, const int levels, const bool compress,
+        const string &context) {
+    const uint64_t N = x.size();
+    const string path = directory / "input.zbpsllh";
+    write_on_root([&] { IO::write_zbpsllh(path, x, levels, 3, compress); });
+    const vector<double> expected = slice(x);
+    const double expectedSum = binary_tree_sum(expected.data(), N);
+
+    // The codec is stored after the magic and the version
+    uint32_t codec;
+    std::ifstream(path, std::ios::binary).seekg(12).read(reinterpret_cast<char *>(&codec), sizeof(codec));
+#ifdef BINARY_TREE_SUMMATION_ZLIB
+    check(codec == (compress ? 1u : 0u), "codec of write_zbpsllh", context);
+#else
+    check(codec == 0, "codec of write_zbpsllh", context);
+#endif
+
+    for (const unsigned int threads : {1u, 3u}) {
+        const string threadContext = context + ", " + std::to_string(threads) + " threads";
+        uint64_t localN = 0;
+        const vector<double> local = IO::read_zbpsllh(path, rank, p, localN, threads);
+        uint64_t collectiveN = 0;
+        const vector<double> collective = IO::read_zbpsllh_mpiio(path, MPI_COMM_WORLD, collectiveN, threads);
+        check(localN == N && equal(local.data(), local.size(), expected), "read_zbpsllh", threadContext);
+        check(collectiveN == N && equal(collective.data(), collective.size(), expected),
+                "read_zbpsllh_mpiio", threadContext);
+
+        const double localSum = binary_tree_sum(local.data(), N);
+        const double collectiveSum = binary_tree_sum(collective.data(), N);
+        check(std::memcmp(&localSum, &expectedSum, sizeof(double)) == 0
+                && std::memcmp(&collectiveSum, &expectedSum, sizeof(double)) == 0,
+                "binary_tree_sum of the .zbpsllh slices", threadContext);
+    }
+}
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+
+    // One directory per run, runs on different numbers of ranks may overlap
+    long id = getpid();
+    MPI_Bcast(&id, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+    directory = std::filesystem::temp_directory_path() / ("io_test_" + std::to_string(id));
+    if (rank == 0) std::filesystem::create_directory(directory);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    // Fewer, as many and more elements than ranks, the largest size spans
+    // several of the chunks MPI-IO reads at once on one or two ranks
+    for (const uint64_t N : {1UL, 2UL, 3UL, 4UL, 7UL, 10UL, 1000UL, 4099UL, (1UL << 21) + 3}) {
+        vector<double> x(N);
+        for (uint64_t i = 0; i < N; i++) x[i] = element(i);
+        const string context = "N = " + std::to_string(N);
+
+        check_binpsllh(x, N, context);
+        // The header claims more elements than the file holds
+        check_binpsllh(x, N + 2, context + ", truncated");
+
+        for (const int levels : {9, 10}) {
+            check_cbpsllh(x, levels, context + ", 2^" + std::to_string(levels) + " per block");
+        }
+
+        for (const int levels : {0, 4, 16}) {
+            // Tiny blocks of many elements take long to compress
+            if (N > 4099 && levels < 16) continue;
+            for (const bool compress : {false, true}) {
+                check_zbpsllh(x, levels, compress, context + ", 2^" + std::to_string(levels)
+                        + " per block" + (compress ? ", zlib" : ", shuffled"));
+            }
+        }
+
+        if (N > 4099) continue;
+
+        // Negative entries of varying magnitude give numbers of varying length
+        vector<double> y(N);
+        for (uint64_t i = 0; i < N; i++) y[i] = std::ldexp(element(i, 1) - 0.5, i % 40 - 20);
+        check_psllh(y, N, context);
+        // The header claims more or fewer entries than the file holds
+        check_psllh(y, N + 3, context + ", too many in header");
+        if (N > 1) check_psllh(y, N - 1, context + ", too few in header");
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (rank == 0) std::filesystem::remove_all(directory);
+
+    MPI_Allreduce(MPI_IN_PLACE, &failures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0 && failures > 0) cerr << failures << " checks failed" << endl;
+    MPI_Finalize();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,393 @@
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <initializer_list>
+#include <mpi.h>
+#include "binarytreesummation.h"
+#include "generator.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+/*
+ * The entry points of the library against a plain recursive evaluation of the
+ * reduction tree, bit for bit: V(i, 0) = x_i and
+ * V(i, y) = V(i, y - 1) + V(i + 2^(y - 1), y - 1) if i + 2^(y - 1) < N,
+ * otherwise V(i, y - 1). The sum is V(0, height). Runs on any number of ranks.
+ */
+
+static int rank, p;
+static int failures = 0;
+
+/*
+ * Element i of the global input, of varying magnitude and sign so that the
+ * result depends on the summation order.
+ */
+static double signed_element(const uint64_t i, const uint64_t seed = 0) {
+    return std::ldexp(element(i, seed) - 0.5, static_cast<int>(32 * element(i, seed + 1000)));
+}
+
+template <typename T>
+static T reference_node(const T *x, const uint64_t N, const uint64_t i, const int y) {
+    if (y == 0) return x[i];
+    const uint64_t right = i + (1UL << (y - 1));
+    const T left = reference_node(x, N, i, y - 1);
+    return (right < N) ? T(left + reference_node(x, N, right, y - 1)) : left;
+}
+
+template <typename T>
+static T reference_sum(const vector<T> &x) {
+    int height = 0;
+    while ((1UL << height) < x.size()) height++;
+    return x.empty() ? T(0) : reference_node(x.data(), x.size(), 0, height);
+}
+
+template <typename T>
+static void check(const T result, const T expected, const string &what, const string &context) {
+    if (std::memcmp(&result, &expected, sizeof(T)) != 0) {
+        cerr << "[ERROR] rank " << rank << ": " << what << " (" << context << ") returned "
+            << result << " instead of " << expected << endl;
+        failures++;
+    }
+}
+
+template <typename T>
+static vector<T> slice(const vector<T> &x, const Distribution &distribution) {
+    return vector<T>(x.begin() + distribution.begin(rank), x.begin() + distribution.end(rank));
+}
+
+/*
+ * Entry points taking the global number of elements, which assume the
+ * "even_remainder_at_end" distribution.
+ */
+static void check_even(const vector<double> &x, const double expected, const string &context) {
+    const uint64_t N = x.size();
+    const Distribution distribution(N, p);
+    const vector<double> local = slice(x, distribution);
+
+    vector<double> copy = local;
+    check(binary_tree_sum(copy.data(), N), expected, "binary_tree_sum(data, N)", context);
+    check(binary_tree_sum(static_cast<const double *>(local.data()), N), expected,
+            "binary_tree_sum(const data, N)", context);
+    BinaryTreeSumWorkspace workspace;
+    check(binary_tree_sum(local.data(), N, workspace), expected,
+            "binary_tree_sum(data, N, workspace)", context);
+
+    // Three lanes, the second and third are other inputs
+    vector<vector<double>> lanes(3);
+    double expectedLanes[3];
+    for (int k = 0; k < 3; k++) {
+        vector<double> y(N);
+        for (uint64_t i = 0; i < N; i++) y[i] = (k == 0) ? x[i] : signed_element(i, k);
+        expectedLanes[k] = reference_sum(y);
+        lanes[k] = slice(y, distribution);
+    }
+    double *laneData[3] = {lanes[0].data(), lanes[1].data(), lanes[2].data()};
+    double results[3];
+    binary_tree_sum_batch(laneData, 3, N, results);
+    for (int k = 0; k < 3; k++) {
+        check(results[k], expectedLanes[k], "binary_tree_sum_batch(data, K, N)", context);
+    }
+
+    check(binary_tree_transform_sum(local.data(), N, [](const double v) { return v * v; }),
+            [&] {
+                vector<double> squares(N);
+                for (uint64_t i = 0; i < N; i++) squares[i] = x[i] * x[i];
+                return reference_sum(squares);
+            }(), "binary_tree_transform_sum(data, N, f)", context);
+
+    size_t position = 0;
+    auto source = [&](double *buffer, const size_t capacity) {
+        const size_t n = std::min(capacity, local.size() - position);
+        std::copy(local.begin() + position, local.begin() + position + n, buffer);
+        position += n;
+        return n;
+    };
+    check(binary_tree_sum_stream(source, N, MPI_COMM_WORLD, 0, 1000), expected,
+            "binary_tree_sum_stream(source, N)", context);
+
+    ReproducibleSumTree tree(local.data(), N);
+    check(tree.sum(), expected, "ReproducibleSumTree::sum", context);
+
+    // Three flushes, each spread evenly over the ranks, the sum after each
+    // one is that of the prefix flushed so far
+    ReproducibleAppendSum appendSum;
+    const uint64_t bounds[] = {0, N / 3, N / 2, N};
+    for (int f = 0; f < 3; f++) {
+        const vector<double> chunk(x.begin() + bounds[f], x.begin() + bounds[f + 1]);
+        const vector<double> part = slice(chunk, Distribution(chunk.size(), p));
+        if (f == 1) {
+            for (const double v : part) appendSum.append(v);
+        } else {
+            appendSum.append(part.data(), part.size());
+        }
+        appendSum.flush();
+        const vector<double> prefix(x.begin(), x.begin() + bounds[f + 1]);
+        check(appendSum.sum(), reference_sum(prefix), "ReproducibleAppendSum::sum after flush "
+                + std::to_string(f), context);
+    }
+}
+
+/*
+ * Entry points taking a plan or a distribution.
+ */
+static void check_distribution(const vector<double> &x, const double expected,
+        const Distribution &distribution, const string &context) {
+    const uint64_t N = x.size();
+    const vector<double> local = slice(x, distribution);
+    const uint64_t begin = distribution.begin(rank);
+    const uint64_t end = distribution.end(rank);
+
+    vector<double> copy = local;
+    check(binary_tree_sum(copy.data(), distribution), expected,
+            "binary_tree_sum(data, distribution)", context);
+    check(binary_tree_sum(static_cast<const double *>(local.data()), distribution), expected,
+            "binary_tree_sum(const data, distribution)", context);
+
+    for (const bool hierarchical : {false, true}) {
+        const string planContext = context + (hierarchical ? ", hierarchical" : "");
+        ReductionPlan plan(distribution, MPI_COMM_WORLD, 0, ResultMode::AllRanks, hierarchical);
+        BinaryTreeSumWorkspace workspace;
+
+        // Repeated reductions reuse the plan
+        for (int repetition = 0; repetition < 2; repetition++) {
+            copy = local;
+            check(binary_tree_sum(copy.data(), plan), expected, "binary_tree_sum(data, plan)",
+                    planContext);
+            check(binary_tree_sum(local.data(), plan, workspace), expected,
+                    "binary_tree_sum(data, plan, workspace)", planContext);
+        }
+
+        double result;
+        copy = local;
+        MPI_Request request = binary_tree_sum_async(copy.data(), plan, &result);
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+        check(result, expected, "binary_tree_sum_async(data, plan)", planContext);
+        request = binary_tree_sum_async(local.data(), plan, workspace, &result);
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+        check(result, expected, "binary_tree_sum_async(data, plan, workspace)", planContext);
+
+        copy = local;
+        vector<double> second = local;
+        double *lanes[2] = {copy.data(), second.data()};
+        double results[2];
+        binary_tree_sum_batch(lanes, 2, results, plan);
+        check(results[0], expected, "binary_tree_sum_batch(data, K, plan)", planContext);
+        check(results[1], expected, "binary_tree_sum_batch(data, K, plan)", planContext);
+        copy = local;
+        second = local;
+        request = binary_tree_sum_batch_async(lanes, 2, results, plan);
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+        check(results[1], expected, "binary_tree_sum_batch_async", planContext);
+
+        // The persistent requests are set up again for a single lane
+        copy = local;
+        check(binary_tree_sum(copy.data(), plan), expected,
+                "binary_tree_sum(data, plan) after batch", planContext);
+
+        for (const size_t chunk : {size_t(7), size_t(1) << 20}) {
+            size_t position = 0;
+            auto source = [&](double *buffer, const size_t capacity) {
+                const size_t n = std::min(capacity, local.size() - position);
+                std::copy(local.begin() + position, local.begin() + position + n, buffer);
+                position += n;
+                return n;
+            };
+            check(binary_tree_sum_stream(source, plan, chunk), expected,
+                    "binary_tree_sum_stream(source, plan)", planContext);
+        }
+
+        // Known sums of the local subtrees of 16 elements at odd multiples of 16
+        vector<SubtreeSum> subtrees;
+        for (uint64_t i = (begin + 31) / 32 * 32 + 16; i + 16 <= end; i += 32) {
+            subtrees.push_back({i, 4, reference_node(x.data(), N, i, 4)});
+        }
+        size_t next = 0;
+        uint64_t position = begin;
+        auto outside = [&](double *buffer, const size_t capacity) {
+            size_t n = 0;
+            while (n < capacity && position < end) {
+                if (next < subtrees.size() && position == subtrees[next].index) {
+                    position += 16;
+                    next++;
+                    continue;
+                }
+                buffer[n++] = x[position++];
+            }
+            return n;
+        };
+        check(binary_tree_sum_stream(outside, subtrees, plan, 5), expected,
+                "binary_tree_sum_stream(source, subtrees, plan)", planContext);
+    }
+
+    ReductionPlan rootOnly(distribution, MPI_COMM_WORLD, 0, ResultMode::RootOnly);
+    copy = local;
+    const double rootResult = binary_tree_sum(copy.data(), rootOnly);
+    if (rank == rootOnly.root_rank()) check(rootResult, expected, "ResultMode::RootOnly", context);
+
+    // Single and mixed precision of the elements rounded to float
+    vector<float> singles(N);
+    vector<double> widened(N);
+    for (uint64_t i = 0; i < N; i++) {
+        singles[i] = static_cast<float>(x[i]);
+        widened[i] = singles[i];
+    }
+    const vector<float> localSingles = slice(singles, distribution);
+    ReductionPlan plan(distribution);
+    BinaryTreeSumWorkspace workspace;
+    check(binary_tree_sum<float>(localSingles.data(), plan, workspace), reference_sum(singles),
+            "binary_tree_sum<float>(float data, plan)", context);
+    check(binary_tree_sum<double>(localSingles.data(), plan, workspace), reference_sum(widened),
+            "binary_tree_sum<double>(float data, plan)", context);
+    vector<float> singlesCopy = localSingles;
+    check(binary_tree_sum(singlesCopy.data(), plan), reference_sum(singles),
+            "binary_tree_sum(float data, plan)", context);
+
+    vector<double> logs(N);
+    vector<double> positives(N);
+    for (uint64_t i = 0; i < N; i++) {
+        positives[i] = std::abs(x[i]) + 1.0;
+        logs[i] = LogTransform()(positives[i]);
+    }
+    const vector<double> localPositives = slice(positives, distribution);
+    check(binary_tree_transform_sum(localPositives.data(), plan, workspace, LogTransform()),
+            reference_sum(logs), "binary_tree_transform_sum(data, plan, LogTransform)", context);
+
+    // Updates of the first and last local element and of one in the middle
+    vector<double> updated = x;
+    ReproducibleSumTree tree(local.data(), distribution);
+    check(tree.sum(), expected, "ReproducibleSumTree::sum", context);
+    if (begin < end) {
+        for (const uint64_t i : {begin, begin + (end - begin) / 2, end - 1}) {
+            updated[i] = signed_element(i, 7);
+            tree.update(i, updated[i]);
+        }
+    }
+    vector<int> counts(p), displacements(p);
+    for (int r = 0; r < p; r++) {
+        counts[r] = distribution.end(r) - distribution.begin(r);
+        displacements[r] = distribution.begin(r);
+    }
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, updated.data(), counts.data(),
+            displacements.data(), MPI_DOUBLE, MPI_COMM_WORLD);
+    check(tree.sum(), reference_sum(updated), "ReproducibleSumTree::sum after update", context);
+}
+
+/*
+ * binary_tree_sum on the halves of MPI_COMM_WORLD with their own inputs,
+ * concurrently with a reduction on MPI_COMM_WORLD with the same tag. The even
+ * ranks reduce on MPI_COMM_WORLD first, the odd ones on their half, so the
+ * messages of both reductions are in flight at the same time and only the
+ * communicator keeps them apart.
+ */
+static void check_communicators(const vector<double> &x, const double expected,
+        const string &context) {
+    const uint64_t N = x.size();
+    const int color = rank % 2;
+    MPI_Comm half;
+    MPI_Comm_split(MPI_COMM_WORLD, color, rank, &half);
+    int halfRank, halfSize;
+    MPI_Comm_rank(half, &halfRank);
+    MPI_Comm_size(half, &halfSize);
+
+    vector<double> y(N);
+    for (uint64_t i = 0; i < N; i++) y[i] = signed_element(i, 10 + color);
+    const double expectedHalf = reference_sum(y);
+
+    const int tag = 7;
+    vector<double> world = slice(x, Distribution(N, p));
+    vector<double> local(y.begin() + startIndex(halfRank, N, halfSize),
+            y.begin() + startIndex(halfRank + 1, N, halfSize));
+    for (int step = 0; step < 2; step++) {
+        if ((step == 0) == (color == 0)) {
+            check(binary_tree_sum(world.data(), N, MPI_COMM_WORLD, tag), expected,
+                    "binary_tree_sum(data, N, MPI_COMM_WORLD, tag)", context);
+        } else {
+            check(binary_tree_sum(local.data(), N, half, tag), expectedHalf,
+                    "binary_tree_sum(data, N, half, tag)", context);
+        }
+    }
+    MPI_Comm_free(&half);
+}
+
+/*
+ * binary_tree_sum_fixed for the compile-time sizes Ns, on each rank alone.
+ */
+template <size_t... Ns>
+static void check_fixed() {
+    ([] {
+        vector<double> x(Ns);
+        for (uint64_t i = 0; i < Ns; i++) x[i] = signed_element(i, rank);
+        check(binary_tree_sum_fixed<Ns>(x.data()), reference_sum(x), "binary_tree_sum_fixed",
+                "N = " + std::to_string(Ns));
+    }(), ...);
+}
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+
+    const SimdKernel kernels[] = {SimdKernel::Scalar, SimdKernel::SSE2, SimdKernel::AVX,
+        SimdKernel::AVX512, SimdKernel::NEON};
+    set_simd_kernel(SimdKernel::Auto);
+    const SimdKernel best = get_simd_kernel();
+
+    // Every kernel supported by the CPU and one or three threads on a few
+    // sizes, all sizes with the default kernel and three threads. The largest
+    // ones span several cache-sized blocks per rank.
+    for (const uint64_t N : {1UL, 2UL, 3UL, 7UL, 8UL, 9UL, 100UL, 1000UL, 4097UL, 65553UL, 300007UL}) {
+        vector<double> x(N);
+        for (uint64_t i = 0; i < N; i++) x[i] = signed_element(i);
+        const double expected = reference_sum(x);
+
+        // All elements on the last rank, the others empty
+        vector<uint64_t> skewed(p + 1, 0);
+        skewed[p] = N;
+
+        const bool allKernels = N == 9 || N == 4097 || N == 65553;
+        for (const SimdKernel kernel : kernels) {
+            if (!allKernels && kernel != best) continue;
+            if (!set_simd_kernel(kernel)) continue;
+            for (const int threads : {1, 3}) {
+                if (!allKernels && threads != 3) continue;
+                set_local_threads(threads);
+                const string context = "N = " + std::to_string(N) + ", kernel "
+                    + std::to_string(static_cast<int>(kernel)) + ", "
+                    + std::to_string(threads) + " threads";
+
+                check_even(x, expected, context);
+                check_communicators(x, expected, context);
+                check_distribution(x, expected, Distribution(N, p), context + ", even");
+                check_distribution(x, expected, aligned_distribution(N, p, 0.1), context + ", aligned");
+                check_distribution(x, expected, aligned_distribution(N, p, 1.5), context + ", loosely aligned");
+                check_distribution(x, expected, Distribution(skewed), context + ", skewed");
+            }
+        }
+    }
+    set_simd_kernel(SimdKernel::Auto);
+    set_local_threads(0);
+
+    // No elements at all, rank 0 is the root and every result is 0
+    {
+        const vector<double> empty;
+        const ReductionPlan plan(0);
+        check(plan.root_rank(), 0, "ReductionPlan::root_rank", "N = 0");
+        check_even(empty, 0.0, "N = 0");
+        check_communicators(empty, 0.0, "N = 0");
+        check_distribution(empty, 0.0, Distribution(0, p), "N = 0, even");
+    }
+
+    check_fixed<0, 1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 64, 100>();
+
+    MPI_Allreduce(MPI_IN_PLACE, &failures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0 && failures > 0) cerr << failures << " checks failed" << endl;
+    MPI_Finalize();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <initializer_list>
+#include <mpi.h>
+#include "binarytreesummation.h"
+#include "generator.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+/*
+ * The per-phase statistics of a library built with
+ * BINARY_TREE_SUMMATION_STATS: the counters must match the communication
+ * pattern of the reduction and the timers must add up. Runs on any number of
+ * ranks.
+ */
+
+static int rank, p;
+static int failures = 0;
+
+static void check(const bool condition, const string &what, const string &context) {
+    if (!condition) {
+        cerr << "[ERROR] rank " << rank << ": " << what << " (" << context << ")" << endl;
+        failures++;
+    }
+}
+
+/*
+ * Statistics of repetitions reductions of K lanes of N elements each.
+ */
+static void check_statistics(const uint64_t N, const size_t K, const int repetitions) {
+    const string context = "N = " + std::to_string(N) + ", K = " + std::to_string(K)
+        + ", " + std::to_string(repetitions) + " calls";
+    const uint64_t begin = startIndex(rank, N, p);
+    const uint64_t end = startIndex(rank + 1, N, p);
+    vector<vector<double>> lanes(K, vector<double>(end - begin));
+
+    reset_sum_statistics();
+    for (int repetition = 0; repetition < repetitions; repetition++) {
+        vector<double *> data(K);
+        for (size_t k = 0; k < K; k++) {
+            for (uint64_t i = begin; i < end; i++) lanes[k][i - begin] = element(i, k);
+            data[k] = lanes[k].data();
+        }
+        vector<double> results(K);
+        if (K == 1) {
+            results[0] = binary_tree_sum(data[0], N);
+        } else {
+            binary_tree_sum_batch(data.data(), K, N, results.data());
+        }
+    }
+    const SumStatistics statistics = get_sum_statistics();
+
+    const ReductionPlan plan(N);
+    check(statistics.calls == uint64_t(repetitions), "calls", context);
+    check(statistics.messagesSent == repetitions * plan.outgoing_summands(), "messagesSent", context);
+    check(statistics.bytesSent == statistics.messagesSent * K * sizeof(double), "bytesSent", context);
+    check(statistics.bytesReceived == statistics.messagesReceived * K * sizeof(double),
+            "bytesReceived", context);
+
+    // Every summand sent is received once, their number only depends on N and p
+    uint64_t counts[2] = {statistics.messagesSent, statistics.messagesReceived};
+    MPI_Allreduce(MPI_IN_PLACE, counts, 2, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    const uint64_t expected = repetitions * message_count(Distribution(N, p));
+    check(counts[0] == expected && counts[1] == expected, "messages of all ranks", context);
+    check(p == 1 || N < uint64_t(p) || expected > 0, "messages between ranks", context);
+
+    check(statistics.totalTime > 0.0, "totalTime", context);
+    check(statistics.receiveWaitTime >= 0.0 && statistics.sendTime >= 0.0
+            && statistics.resultTime >= 0.0, "phase times", context);
+    check(statistics.receiveWaitTime + statistics.sendTime + statistics.resultTime
+            <= statistics.totalTime, "phase times within totalTime", context);
+}
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+
+    for (const uint64_t N : {1UL, 7UL, 1000UL, 65553UL}) {
+        for (const size_t K : {1UL, 3UL}) {
+            for (const int repetitions : {1, 2}) {
+                check_statistics(N, K, repetitions);
+            }
+        }
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &failures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0 && failures > 0) cerr << failures << " checks failed" << endl;
+    MPI_Finalize();
+    return failures == 0 ? 0 : 1;
+}